@@ -8,6 +8,7 @@
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
 #include <gtc/type_ptr.hpp>
+#include <gtc/quaternion.hpp>
 #include <iostream>
 #include <time.h>
 #include <string.h>
@@ -16,9 +17,34 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <tuple>
+#include <algorithm>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <functional>
+#include <cfloat>
+#include <cstdint>
+#include <cstdio>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_USE_SSE
+#endif
+#ifndef NDEBUG
+#define ENABLE_GL_CHECKS    // GL error reporting, compiled out of release builds
+#endif
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 
 // Constants
 // --------------------
@@ -26,6 +52,19 @@
 // Flags
 const bool enable_keyboard_movement = true;
 const bool enable_mouse_movement = true;
+const bool enable_texture_streaming = true;
+const bool enable_meshlet_culling = true;
+const bool enable_meshlet_cone_culling = true;   // Closed meshes only, which are drawn with GL_CULL_FACE
+const bool enable_camera_collision = true;
+const bool enable_dynamic_resolution = true;
+const bool enable_on_demand_rendering = true;     // Skip frames while nothing changes
+const bool enable_split_screen = false;           // Player and overhead views drawn in one pass
+const bool enable_reflection_probe = true;        // [C] captures a cubemap around the camera
+const bool enable_static_batching = false;        // Merge models that never move into world space batches
+const bool enable_gl_debug_output = true;         // KHR_debug callback instead of glGetError polling, debug builds only
+const bool enable_frame_capture = false;
+const bool capture_headless = false;    // Hide the window and render captured frames offscreen
+const bool run_benchmarks = false;    // Run benchmarks and exit before opening the window
 
 const double PI = 3.14159265358979323846;
 const float WINDOW_WIDTH = 800.0f;
@@ -38,6 +77,76 @@ const float MAX_CAMERA_YAW = 360.0f;
 const float MIN_CAMERA_YAW = 0.0f;
 const float CAMERA_BASIC_SPEED = 3.0f;
 const float CAMERA_FAST_SPEED = 9.0f;
+const float CAMERA_COLLISION_RADIUS = 0.2f;
+const float CAMERA_COLLISION_SKIN = 0.01f;     // Gap kept between the camera sphere and geometry
+
+// Texture streaming
+const size_t TEXTURE_MEMORY_BUDGET = 32 * 1024 * 1024;  // Bytes of texture data allowed on the GPU
+const int TEXTURE_STREAMING_MIN_SIZE = 64;              // Longest side of the coarsest mip that always stays resident
+const int TEXTURE_UPLOADS_PER_FRAME = 1;                // Mip level increases allowed per frame
+
+// Scene graph
+const int SCENE_PARALLEL_THRESHOLD = 16384;     // Nodes in a depth level before the update is split across threads
+const int SCENE_BENCHMARK_NODES = 1000000;
+
+// Meshlets
+const size_t MESHLET_MAX_VERTICES = 64;
+const size_t MESHLET_MAX_TRIANGLES = 124;
+const float MESHLET_CONE_WEIGHT = 0.5f;     // 0 builds meshlets for vertex reuse only, towards 1 favours narrow normal cones
+const float MESHLET_CONE_SPLIT_COS = 0.5f;  // A triangle turned further than this from the cone axis starts a new meshlet
+const size_t MESHLET_SEARCH_WINDOW = 1024;   // Remaining triangles scored when a meshlet runs out of neighbours
+
+// Static batching
+const float STATIC_BATCH_CELL_SIZE = 32.0f;     // Grid cell edge, meshes in one cell share a batch
+const size_t STATIC_BATCH_MAX_VERTICES = 65536; // A full batch is closed and the cell starts another
+const int STATIC_BATCH_BENCHMARK_PROPS = 20000;
+
+// Frame capture
+const int CAPTURE_WIDTH = 1920;                 // Offscreen size used by headless capture
+const int CAPTURE_HEIGHT = 1080;
+const int CAPTURE_FRAME_COUNT = 600;            // Frames captured before exiting, 0 to run until closed
+const size_t CAPTURE_PBO_COUNT = 3;             // Readbacks in flight
+const size_t CAPTURE_WORKER_THREADS = 2;
+const size_t CAPTURE_MAX_QUEUED_FRAMES = 16;    // Frames waiting for the writers before new ones are dropped
+const bool CAPTURE_WRITE_PNG = true;            // PNG or raw RGBA
+const std::string CAPTURE_PATH = "capture/";    // Created when missing
+
+// On-demand rendering
+const int ON_DEMAND_FRAME_CAP = 60;             // Frames per second while the scene changes, 0 for no cap
+
+// Dynamic resolution
+const float DRS_MIN_SCALE = 0.5f;               // Fraction of the output resolution per axis
+const float DRS_MAX_SCALE = 1.0f;
+const float DRS_TARGET_FRAME_MS = 16.6f;        // GPU time budget per frame
+const float DRS_SCALE_DOWN_THRESHOLD = 0.95f;   // Fraction of the budget that triggers a lower resolution
+const float DRS_SCALE_UP_THRESHOLD = 0.75f;     // Fraction of the budget below which resolution grows again
+const float DRS_SCALE_STEP = 0.05f;
+const float DRS_SMOOTHING = 0.1f;               // Weight of the newest GPU time sample
+const int DRS_COOLDOWN_FRAMES = 30;             // Frames between two resolution changes
+const float DRS_SHARPNESS = 0.3f;               // Upscale sharpening, 0 for plain bilinear
+const bool DRS_LOG_DECISIONS = true;
+const size_t DRS_QUERY_COUNT = 4;               // Timer queries in flight
+
+// Multi-view rendering
+const int MULTIVIEW_MAX_VIEWS = 6;              // Views per pass, a cubemap needs all six
+const float SPLIT_SCREEN_OVERHEAD_HEIGHT = 8.0f;
+const int REFLECTION_PROBE_SIZE = 256;          // Cube face size in pixels
+
+// BVH
+const int BVH_BINS = 12;                        // SAH candidate splits per axis
+const unsigned int BVH_MAX_LEAF_SIZE = 4;          // Larger nodes are always split, smaller ones only when SAH says it pays
+const float BVH_TRAVERSAL_COST = 1.0f;              // SAH cost of visiting a node, relative to
+const float BVH_INTERSECTION_COST = 1.0f;           // the cost of testing one triangle
+const int BVH_MAX_DEPTH = 64;                   // Traversal stack size, deeper branches fall back to median splits
+const unsigned int BVH_PARALLEL_THRESHOLD = 65536;  // Primitives in a node before its children build on separate threads
+const int BVH_BENCHMARK_TRIANGLES = 1000000;
+const int BVH_BENCHMARK_INSTANCES = 4;
+const int BVH_BENCHMARK_RAYS = 1000000;
+
+// GL debug output
+const bool DEBUG_OUTPUT_SYNCHRONOUS = false;     // Report inside the failing call, serializes the driver
+const GLenum DEBUG_OUTPUT_MIN_SEVERITY = GL_DEBUG_SEVERITY_LOW;     // Notifications are below LOW
+const int ERROR_CHECK_BENCHMARK_CALLS = 100000;
 
 // Strings
 const std::string WINDOW_TITLE = "OpenGL";
@@ -93,6 +202,233 @@ void main()
 }
 )glsl";
 
+// Upscale pass: full screen triangle built from gl_VertexID, no vertex buffer needed
+const GLchar* upscale_vertex_source = R"glsl(
+#version 150 core
+
+out vec2 TexCoord;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    TexCoord = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
+)glsl";
+
+// Samples the scaled region of the scene texture with an optional sharpening filter
+const GLchar* upscale_fragment_source = R"glsl(
+#version 150 core
+
+in vec2 TexCoord;
+
+uniform sampler2D scene;      // Internal render target
+uniform vec2 uv_scale;        // Part of the texture holding this frame
+uniform vec2 texel_size;      // Size of one texel of the scene texture
+uniform float sharpness;      // Strength of the unsharp mask
+
+out vec4 outColor;
+
+vec3 fetch(vec2 uv)
+{
+    // Never read past the rendered region
+    return texture(scene, clamp(uv, texel_size * 0.5, uv_scale - texel_size * 0.5)).rgb;
+}
+
+void main()
+{
+    vec2 uv = TexCoord * uv_scale;
+    vec3 color = fetch(uv);
+
+    if (sharpness > 0.0)
+    {
+        vec3 neighbours = fetch(uv + vec2(texel_size.x, 0.0)) + fetch(uv - vec2(texel_size.x, 0.0))
+            + fetch(uv + vec2(0.0, texel_size.y)) + fetch(uv - vec2(0.0, texel_size.y));
+        color = clamp(color + sharpness * (color * 4.0 - neighbours), 0.0, 1.0);
+    }
+
+    outColor = vec4(color, 1.0);
+}
+)glsl";
+
+// Multi-view: one instanced draw covers every view, gl_InstanceID selects the view.
+// Compiled after a header holding the version, MAX_VIEWS and optionally LAYERED
+const GLchar* multiview_vertex_source = R"glsl(
+in vec3 position;
+in vec2 texcoord;
+
+uniform mat4 model_matrix;
+uniform mat4 view_proj[MAX_VIEWS];
+uniform vec4 view_rect[MAX_VIEWS];    // NDC scale (xy) and offset (zw) of each view's tile
+uniform int view_remap[MAX_VIEWS];    // Instance to view, lists only views that did not cull the model
+
+#ifdef LAYERED
+out vec2 vs_TexCoord;
+flat out int vs_View;
+#else
+out vec2 TexCoord;
+out float gl_ClipDistance[4];
+#endif
+
+void main()
+{
+    int view = view_remap[gl_InstanceID];
+    vec4 clip = view_proj[view] * model_matrix * vec4(position, 1.0);
+
+#ifdef LAYERED
+    vs_TexCoord = texcoord;
+    vs_View = view;
+    gl_Position = clip;
+#else
+    // Clip to the view's own frustum sides, then squeeze the view into its tile
+    TexCoord = texcoord;
+    gl_ClipDistance[0] = clip.w + clip.x;
+    gl_ClipDistance[1] = clip.w - clip.x;
+    gl_ClipDistance[2] = clip.w + clip.y;
+    gl_ClipDistance[3] = clip.w - clip.y;
+    clip.xy = clip.xy * view_rect[view].xy + view_rect[view].zw * clip.w;
+    gl_Position = clip;
+#endif
+}
+)glsl";
+
+// Sends each triangle to the layer of its view, cube faces when rendering into a cubemap
+const GLchar* multiview_geometry_source = R"glsl(
+#version 150 core
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+in vec2 vs_TexCoord[];
+flat in int vs_View[];
+
+out vec2 TexCoord;
+
+void main()
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        gl_Layer = vs_View[0];
+        TexCoord = vs_TexCoord[i];
+        gl_Position = gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
+)glsl";
+
+// GL Debug Output
+// ------------------
+#ifdef ENABLE_GL_CHECKS
+std::atomic<const char*> gl_debug_checkpoint("");    // Last check_gl_error context, read by the callback
+bool gl_debug_output = false;                         // Callback installed, glGetError polling skipped
+
+const char* gl_debug_source_name(GLenum source)
+{
+    switch (source)
+    {
+    case GL_DEBUG_SOURCE_API: return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "Window System";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader Compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY: return "Third Party";
+    case GL_DEBUG_SOURCE_APPLICATION: return "Application";
+    default: return "Other";
+    }
+}
+
+const char* gl_debug_type_name(GLenum type)
+{
+    switch (type)
+    {
+    case GL_DEBUG_TYPE_ERROR: return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behaviour";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behaviour";
+    case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+    case GL_DEBUG_TYPE_MARKER: return "marker";
+    default: return "other";
+    }
+}
+
+// Severity enums are not ordered by value, higher rank is more severe
+int gl_debug_severity_rank(GLenum severity)
+{
+    switch (severity)
+    {
+    case GL_DEBUG_SEVERITY_HIGH: return 3;
+    case GL_DEBUG_SEVERITY_MEDIUM: return 2;
+    case GL_DEBUG_SEVERITY_LOW: return 1;
+    default: return 0;
+    }
+}
+
+// May run on a driver thread unless DEBUG_OUTPUT_SYNCHRONOUS is set, the checkpoint is then approximate
+void GLAPIENTRY gl_debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei /*length*/, const GLchar* message, const void* /*user_param*/)
+{
+    static const char* severity_names[4] = { "notification", "low", "medium", "high" };
+    std::cerr << "OpenGL " << severity_names[gl_debug_severity_rank(severity)] << " " << gl_debug_type_name(type)
+        << " from " << gl_debug_source_name(source) << " (id " << id << ", after " << gl_debug_checkpoint.load(std::memory_order_relaxed) << "): "
+        << message << "\n";
+}
+
+// Installs the KHR_debug callback. Returns false when unavailable, check_gl_error then
+// keeps polling glGetError
+bool init_gl_debug_output(bool synchronous, GLenum min_severity)
+{
+    if (!GLEW_KHR_debug)
+        return false;
+
+    glDebugMessageCallback(gl_debug_callback, NULL);
+    glEnable(GL_DEBUG_OUTPUT);
+    if (synchronous)
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    else
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+
+    // Drop everything, then let each severity at or above the minimum through
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_FALSE);
+    const GLenum severities[4] = { GL_DEBUG_SEVERITY_NOTIFICATION, GL_DEBUG_SEVERITY_LOW, GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_HIGH };
+    for (GLenum severity : severities)
+    {
+        if (gl_debug_severity_rank(severity) >= gl_debug_severity_rank(min_severity))
+            glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severity, 0, NULL, GL_TRUE);
+    }
+
+    gl_debug_output = true;
+    return true;
+}
+
+void release_gl_debug_output()
+{
+    if (gl_debug_output)
+    {
+        glDisable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(NULL, NULL);
+        gl_debug_output = false;
+    }
+}
+
+// Names an object in debug messages and GPU debuggers. identifier is GL_BUFFER, GL_TEXTURE, GL_PROGRAM...
+void label_gl_object(GLenum identifier, GLuint object, const std::string& label)
+{
+    if (gl_debug_output && object != 0)
+        glObjectLabel(identifier, object, -1, label.c_str());
+}
+#else
+inline bool init_gl_debug_output(bool, GLenum)
+{
+    return false;
+}
+
+inline void release_gl_debug_output()
+{
+}
+
+inline void label_gl_object(GLenum, GLuint, const std::string&)
+{
+}
+#endif
+
 // Validation functions
 // ------------------
 bool shader_compiled(GLuint shader, bool console_dump = true, std::string name_identifier = "")
@@ -144,287 +480,3275 @@ bool program_linked(GLuint program, bool console_dump = true, std::string name_i
     return success;
 }
 
-void check_gl_error(const std::string& context)
+#ifdef ENABLE_GL_CHECKS
+// Once the debug callback is installed errors are reported by the driver and checkpoints
+// only record where the program was, so no call here waits on the GPU
+void check_gl_error(const char* context)
 {
+    gl_debug_checkpoint.store(context, std::memory_order_relaxed);
+    if (gl_debug_output)
+        return;
+
     GLenum err;
     while ((err = glGetError()) != GL_NO_ERROR)
     {
         std::cerr << "OpenGL error in " << context << ": " << err << "\n";
     }
 }
+#else
+inline void check_gl_error(const char*)
+{
+}
+#endif
 
-// Model Structure
+// GPU Memory Accounting
 // ------------------
-struct Model
+enum GpuMemoryCategory
 {
-    std::string name;
-    std::vector<GLfloat> vertices; // Positions and texture cords
-    std::vector<GLuint> indices;
-    GLuint vao;
-    GLuint vbo;
-    GLuint ebo;
-    glm::mat4 model_matrix;
-    glm::vec3 color;    // Model colour
-    GLuint texture;    // ID. Equal to 0 if not present
-    std::string texture_name;
+    GPU_MEMORY_VERTEX_BUFFER,
+    GPU_MEMORY_INDEX_BUFFER,
+    GPU_MEMORY_TEXTURE,
+    GPU_MEMORY_RENDER_TARGET,
+    GPU_MEMORY_RENDERBUFFER,
+    GPU_MEMORY_PIXEL_BUFFER,
+    GPU_MEMORY_CATEGORY_COUNT
+};
 
-    // Constructor
-    Model(const std::string name, const std::vector<GLfloat>& verts, const std::vector<GLuint>& inds, const glm::vec3& col, const GLuint shader_prog, GLuint tex = 0, std::string tex_name = "")
-        : name(name), vertices(verts), indices(inds), color(col), texture(tex), texture_name(tex_name), model_matrix(1.0f)
+const char* gpu_memory_category_name(GpuMemoryCategory category)
+{
+    switch (category)
     {
-        // VAO, VBO, EBO Initialization
-        glGenVertexArrays(1, &vao);
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
+    case GPU_MEMORY_VERTEX_BUFFER: return "Vertex buffers";
+    case GPU_MEMORY_INDEX_BUFFER:  return "Index buffers";
+    case GPU_MEMORY_TEXTURE:       return "Textures";
+    case GPU_MEMORY_RENDER_TARGET: return "Render targets";
+    case GPU_MEMORY_RENDERBUFFER:  return "Renderbuffers";
+    case GPU_MEMORY_PIXEL_BUFFER:  return "Pixel buffers";
+    default:                       return "Unknown";
+    }
+}
 
-        glBindVertexArray(vao);
+struct GpuAllocation
+{
+    GpuMemoryCategory category;
+    std::string owner;  // Name of the model or texture the object belongs to
+    size_t bytes;
+};
 
-        // Vertex Buffer
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
-        check_gl_error("VBO Setup");
+// Records every GL allocation so totals and high-water marks can be reported.
+// Sizes are computed from the data handed to GL, drivers may pad them further.
+struct GpuMemoryTracker
+{
+    std::map<std::pair<int, GLuint>, GpuAllocation> allocations; // Keyed by (category, GL object name)
+    size_t category_bytes[GPU_MEMORY_CATEGORY_COUNT] = {};
+    size_t category_peak[GPU_MEMORY_CATEGORY_COUNT] = {};
+    size_t total_bytes = 0;
+    size_t total_peak = 0;
+
+    // Record an allocation. Re-specifying the same object replaces its previous size
+    void track_allocation(GpuMemoryCategory category, GLuint id, size_t bytes, const std::string& owner)
+    {
+        track_release(category, id);
 
-        // Element Buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
-        check_gl_error("EBO Setup");
+        allocations[std::make_pair(static_cast<int>(category), id)] = GpuAllocation{ category, owner, bytes };
+        category_bytes[category] += bytes;
+        total_bytes += bytes;
 
-        // Positional attribute
-        GLint pos_attrib = glGetAttribLocation(shader_prog, "position");
-        if (pos_attrib == -1)
+        category_peak[category] = std::max(category_peak[category], category_bytes[category]);
+        total_peak = std::max(total_peak, total_bytes);
+    }
+
+    void track_release(GpuMemoryCategory category, GLuint id)
+    {
+        auto it = allocations.find(std::make_pair(static_cast<int>(category), id));
+        if (it == allocations.end())
+            return;
+
+        category_bytes[category] -= it->second.bytes;
+        total_bytes -= it->second.bytes;
+        allocations.erase(it);
+    }
+
+    void print_report() const
+    {
+        std::cout << SEPARATOR;
+        std::cout << "GPU memory: " << to_megabytes(total_bytes) << " MB (peak " << to_megabytes(total_peak) << " MB)\n";
+        for (int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; ++i)
         {
-            std::cerr << "Attribute 'position' not found in shader.\n";
+            std::cout << "\t" << gpu_memory_category_name(static_cast<GpuMemoryCategory>(i)) << "="
+                << to_megabytes(category_bytes[i]) << " MB (peak " << to_megabytes(category_peak[i]) << " MB)\n";
         }
-        glEnableVertexAttribArray(pos_attrib);
-        glVertexAttribPointer(pos_attrib, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)0); // 3 positions + 2 texcoords
-        check_gl_error("Vertex Position Attribute Setup");
 
-        // Texture Coordinate attribute
-        GLint tex_attrib = glGetAttribLocation(shader_prog, "texcoord");
-        if (tex_attrib == -1)
+        // Sum per owner so shared objects show up once per model or texture
+        std::map<std::string, size_t> owner_bytes;
+        for (const auto& allocation : allocations)
         {
-            std::cerr << "Attribute 'texcoord' not found in shader.\n";
+            owner_bytes[allocation.second.owner] += allocation.second.bytes;
         }
-        glEnableVertexAttribArray(tex_attrib);
-        glVertexAttribPointer(tex_attrib, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat))); // Positional offset
-        check_gl_error("Vertex TexCoord Attribute Setup");
 
-        glBindVertexArray(0);
+        for (const auto& owner : owner_bytes)
+        {
+            std::cout << "\t\t" << owner.first << "=" << to_megabytes(owner.second) << " MB\n";
+        }
     }
 
-    // Destructor
-    ~Model()
+    static double to_megabytes(size_t bytes)
     {
-        glDeleteBuffers(1, &vbo);
-        glDeleteBuffers(1, &ebo);
-        glDeleteVertexArrays(1, &vao);
-        if (texture != 0)
-            glDeleteTextures(1, &texture);
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
     }
+};
 
-    // Model rendering function
-    void draw(GLuint shader_program)
+GpuMemoryTracker gpu_memory;
+
+// Scene Graph
+// ------------------
+typedef int SceneNode;  // Stable handle, survives reordering of the arrays
+const SceneNode NO_SCENE_NODE = -1;
+
+// Threads kept alive between runs. run() calls task(t) once for every t below task_count(),
+// on the workers and the calling thread, and returns when all calls have finished
+struct WorkerPool
+{
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    const std::function<void(int)>* task = nullptr;
+    unsigned long generation = 0;     // Bumped by every run, workers wait for a new value
+    int pending = 0;
+    bool stopping = false;
+
+    ~WorkerPool()
     {
-        // Set model matrix
-        GLint uni_model = glGetUniformLocation(shader_program, "model_matrix");
-        if (uni_model == -1)
         {
-            std::cerr << "Uniform 'model_matrix' not found.\n";
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
         }
-        glUniformMatrix4fv(uni_model, 1, GL_FALSE, glm::value_ptr(model_matrix));
+        work_ready.notify_all();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
 
-        // Set model's color
-        GLint uni_color = glGetUniformLocation(shader_program, "model_color");
-        if (uni_color == -1)
+    void start(int worker_count)
+    {
+        for (int i = 0; i < worker_count; ++i)
         {
-            std::cerr << "Uniform 'model_color' not found.\n";
+            threads.push_back(std::thread(&WorkerPool::worker_loop, this, i));
         }
-        glUniform3fv(uni_color, 1, glm::value_ptr(color));
+    }
 
-        // Set flag of using texture
-        GLint uni_use_texture = glGetUniformLocation(shader_program, "use_texture");
-        if (uni_use_texture == -1)
+    bool started() const
+    {
+        return !threads.empty();
+    }
+
+    int task_count() const
+    {
+        return static_cast<int>(threads.size()) + 1;
+    }
+
+    void run(const std::function<void(int)>& work)
+    {
         {
-            std::cerr << "Uniform 'use_texture' not found.\n";
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &work;
+            pending = static_cast<int>(threads.size());
+            generation++;
         }
-        glUniform1i(uni_use_texture, texture != 0 ? 1 : 0);
+        work_ready.notify_all();
 
-        // Bind the texture if available
-        if (texture != 0)
+        // The calling thread takes the last task instead of idling
+        work(static_cast<int>(threads.size()));
+
+        std::unique_lock<std::mutex> lock(mutex);
+        work_done.wait(lock, [this]() { return pending == 0; });
+        task = nullptr;
+    }
+
+    void worker_loop(int index)
+    {
+        unsigned long seen = 0;
+        while (true)
         {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texture);
-            GLint uni_tex = glGetUniformLocation(shader_program, "tex");
-            if (uni_tex == -1)
+            const std::function<void(int)>* work;
             {
-                std::cerr << "Uniform 'tex' not found.\n";
+                std::unique_lock<std::mutex> lock(mutex);
+                work_ready.wait(lock, [this, seen]() { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                work = task;
             }
-            glUniform1i(uni_tex, 0);
-        }
 
-        // Rendering
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        check_gl_error("Drawing Model");
+            (*work)(index);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                work_done.notify_one();
+        }
     }
 };
 
-// Shapes
-// --------------------
-bool load_obj(const std::string& filePath, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+// Transform hierarchy stored as parallel arrays ordered by depth.
+// Parents always come before their children, so one pass per depth level is enough
+// to refresh world matrices, and nodes within a level can be processed in parallel.
+struct SceneGraph
 {
-    std::ifstream file(filePath);
-    if (!file.is_open())
+    // Hot data, indexed by position in depth order
+    std::vector<glm::vec3> local_position;
+    std::vector<glm::quat> local_rotation;
+    std::vector<glm::vec3> local_scale;
+    std::vector<glm::mat4> world_matrix;
+    std::vector<int> parent;              // Index of parent, -1 for roots
+    std::vector<unsigned char> dirty;     // Local transform changed since last update
+
+    // Hierarchy bookkeeping
+    std::vector<int> depth;
+    std::vector<int> level_start;         // First index of each depth level, plus the end
+    std::vector<SceneNode> handle_to_index;
+    std::vector<int> index_to_handle;
+    bool order_dirty = false;
+    bool levels_dirty = false;
+    bool any_dirty = false;
+    WorkerPool workers;                   // Started by the first level large enough to split
+
+    SceneNode add_node(SceneNode parent_node = NO_SCENE_NODE, const glm::vec3& position = glm::vec3(0.0f),
+        const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f))
     {
-        std::cerr << "Error: Cannot open file " << filePath << "\n";
-        return false;
+        int parent_index = (parent_node == NO_SCENE_NODE) ? -1 : handle_to_index[parent_node];
+        int node_depth = (parent_index == -1) ? 0 : depth[parent_index] + 1;
+
+        // Appending keeps the order valid unless the new node is shallower than the last one
+        if (!depth.empty() && node_depth < depth.back())
+            order_dirty = true;
+        levels_dirty = true;
+        any_dirty = true;
+
+        SceneNode handle = static_cast<SceneNode>(handle_to_index.size());
+        handle_to_index.push_back(static_cast<int>(parent.size()));
+        index_to_handle.push_back(handle);
+
+        local_position.push_back(position);
+        local_rotation.push_back(rotation);
+        local_scale.push_back(scale);
+        world_matrix.push_back(glm::mat4(1.0f));
+        parent.push_back(parent_index);
+        dirty.push_back(1);
+        depth.push_back(node_depth);
+
+        return handle;
     }
 
-    std::vector<glm::vec3> temp_positions;
-    std::vector<glm::vec2> temp_texcoords;
-    std::vector<GLuint> temp_indices;
+    void set_local_position(SceneNode node, const glm::vec3& position)
+    {
+        int index = handle_to_index[node];
+        local_position[index] = position;
+        dirty[index] = 1;
+        any_dirty = true;
+    }
 
-    std::string line;
-    while (std::getline(file, line))
+    void set_local_rotation(SceneNode node, const glm::quat& rotation)
     {
-        std::istringstream ss(line);
-        std::string prefix;
-        ss >> prefix;
+        int index = handle_to_index[node];
+        local_rotation[index] = rotation;
+        dirty[index] = 1;
+        any_dirty = true;
+    }
 
-        if (prefix == "v")
+    void set_local_scale(SceneNode node, const glm::vec3& scale)
+    {
+        int index = handle_to_index[node];
+        local_scale[index] = scale;
+        dirty[index] = 1;
+        any_dirty = true;
+    }
+
+    const glm::mat4& get_world_matrix(SceneNode node) const
+    {
+        return world_matrix[handle_to_index[node]];
+    }
+
+    size_t size() const
+    {
+        return parent.size();
+    }
+
+    // Bytes held by the arrays, including unused capacity
+    size_t memory_bytes() const
+    {
+        return local_position.capacity() * sizeof(glm::vec3)
+            + local_rotation.capacity() * sizeof(glm::quat)
+            + local_scale.capacity() * sizeof(glm::vec3)
+            + world_matrix.capacity() * sizeof(glm::mat4)
+            + parent.capacity() * sizeof(int)
+            + dirty.capacity() * sizeof(unsigned char)
+            + depth.capacity() * sizeof(int)
+            + level_start.capacity() * sizeof(int)
+            + handle_to_index.capacity() * sizeof(SceneNode)
+            + index_to_handle.capacity() * sizeof(int);
+    }
+
+    // Recompute world matrices of dirty nodes and their descendants.
+    // Returns the number of matrices that changed
+    size_t update()
+    {
+        if (!any_dirty)
+            return 0;
+
+        if (order_dirty)
+            sort_by_depth();
+        if (levels_dirty)
+            build_levels();
+
+        size_t updated = 0;
+        for (size_t level = 0; level + 1 < level_start.size(); ++level)
         {
-            glm::vec3 position;
-            ss >> position.x >> position.y >> position.z;
-            temp_positions.push_back(position);
+            int begin = level_start[level];
+            int end = level_start[level + 1];
+
+            int thread_count = static_cast<int>(std::thread::hardware_concurrency());
+            if (end - begin < SCENE_PARALLEL_THRESHOLD || thread_count < 2)
+            {
+                updated += update_range(begin, end);
+                continue;
+            }
+            if (!workers.started())
+                workers.start(thread_count - 1);
+
+            // Nodes in a level only read their parents' level, so chunks are independent
+            int task_count = workers.task_count();
+            std::vector<size_t> counts(task_count, 0);
+            int chunk = (end - begin + task_count - 1) / task_count;
+            workers.run([this, &counts, begin, end, chunk](int t)
+                {
+                    int chunk_begin = begin + t * chunk;
+                    int chunk_end = std::min(chunk_begin + chunk, end);
+                    if (chunk_begin < chunk_end)
+                        counts[t] = update_range(chunk_begin, chunk_end);
+                });
+            for (size_t count : counts)
+            {
+                updated += count;
+            }
         }
-        else if (prefix == "vt")
+
+        std::fill(dirty.begin(), dirty.end(), 0);
+        any_dirty = false;
+        return updated;
+    }
+
+    // Dirty flags are pushed down as each level is processed
+    size_t update_range(int begin, int end)
+    {
+        size_t updated = 0;
+        for (int i = begin; i < end; ++i)
         {
-            glm::vec2 texcoord;
-            ss >> texcoord.x >> texcoord.y;
-            temp_texcoords.push_back(texcoord);
+            int parent_index = parent[i];
+            if (parent_index != -1)
+                dirty[i] |= dirty[parent_index];
+            if (!dirty[i])
+                continue;
+
+            glm::mat4 local = glm::mat4_cast(local_rotation[i]);
+            local[0] *= local_scale[i].x;
+            local[1] *= local_scale[i].y;
+            local[2] *= local_scale[i].z;
+            local[3] = glm::vec4(local_position[i], 1.0f);
+
+            world_matrix[i] = (parent_index == -1) ? local : world_matrix[parent_index] * local;
+            updated++;
         }
-        else if (prefix == "f")
-        {
-            std::string vertexStr;
-            for (int i = 0; i < 3; ++i)
+        return updated;
+    }
+
+    // Stable reorder of every array by depth, remapping parents and handles
+    void sort_by_depth()
+    {
+        std::vector<int> order(size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            order[i] = static_cast<int>(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return depth[a] < depth[b]; });
+
+        std::vector<int> new_index(size());
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            new_index[order[i]] = static_cast<int>(i);
+        }
+
+        permute(local_position, order);
+        permute(local_rotation, order);
+        permute(local_scale, order);
+        permute(world_matrix, order);
+        permute(dirty, order);
+        permute(depth, order);
+        permute(index_to_handle, order);
+        permute(parent, order);
+        for (int& parent_index : parent)
+        {
+            if (parent_index != -1)
+                parent_index = new_index[parent_index];
+        }
+        for (size_t i = 0; i < index_to_handle.size(); ++i)
+        {
+            handle_to_index[index_to_handle[i]] = static_cast<int>(i);
+        }
+
+        order_dirty = false;
+        levels_dirty = true;
+    }
+
+    void build_levels()
+    {
+        level_start.clear();
+        for (size_t i = 0; i < depth.size(); ++i)
+        {
+            while (static_cast<int>(level_start.size()) <= depth[i])
+                level_start.push_back(static_cast<int>(i));
+        }
+        level_start.push_back(static_cast<int>(depth.size()));
+        levels_dirty = false;
+    }
+
+    template <typename T>
+    static void permute(std::vector<T>& values, const std::vector<int>& order)
+    {
+        std::vector<T> result;
+        result.reserve(values.size());
+        for (int index : order)
+        {
+            result.push_back(values[index]);
+        }
+        values.swap(result);
+    }
+};
+
+// Culling
+// ------------------
+struct Frustum
+{
+    glm::vec4 planes[6];   // xyz = inward normal, w = distance
+
+    // Gribb-Hartmann extraction from the combined projection * view matrix
+    static Frustum from_matrix(const glm::mat4& view_proj)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            rows[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+        }
+
+        Frustum frustum;
+        for (int i = 0; i < 3; ++i)
+        {
+            frustum.planes[i * 2] = rows[3] + rows[i];
+            frustum.planes[i * 2 + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4& plane : frustum.planes)
+        {
+            plane = plane / glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    bool sphere_visible(const glm::vec3& center, float radius) const
+    {
+        for (const glm::vec4& plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Cluster of up to MESHLET_MAX_TRIANGLES triangles stored contiguously in the index buffer
+struct Meshlet
+{
+    GLuint index_offset;    // First index in the model's index buffer
+    GLsizei index_count;
+    glm::vec3 center;       // Bounding sphere in model space
+    float radius;
+    glm::vec3 cone_axis;    // Average facing direction of the triangles
+    float cone_cos;         // Cosine of the widest angle from the axis, -1 if the cone is unusable
+    float cone_sin;
+
+    // True when every triangle faces away from a camera at camera_pos (model space)
+    bool backfacing(const glm::vec3& camera_pos) const
+    {
+        if (cone_cos <= 0.0f)
+            return false;
+
+        glm::vec3 to_center = center - camera_pos;
+        float distance = glm::length(to_center);
+        if (distance <= radius)
+            return false;
+
+        // Angle to the axis must stay below 90 degrees minus the cone and the sphere's angular size
+        float sphere_sin = radius / distance;
+        float sphere_cos = std::sqrt(1.0f - sphere_sin * sphere_sin);
+
+        // Cone and sphere together span 90 degrees or more, some triangle may face the camera
+        if (cone_cos * sphere_cos - cone_sin * sphere_sin <= 0.0f)
+            return false;
+
+        float limit = cone_sin * sphere_cos + cone_cos * sphere_sin;
+        return glm::dot(to_center, cone_axis) > limit * distance;
+    }
+};
+
+// Bounding Volume Hierarchy
+// ------------------
+
+// 32 bytes, two nodes per cache line. Children of a node are always stored next to each other
+struct BVHNode
+{
+    float bounds_min[3];
+    unsigned int left_first;    // Left child for inner nodes (right is left + 1), first primitive for leaves
+    float bounds_max[3];
+    unsigned int count;         // Primitives in a leaf, 0 for inner nodes
+};
+
+struct BVHRay
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec3 inv_direction;
+#ifdef BVH_USE_SSE
+    __m128 origin4;
+    __m128 inv_direction4;
+#endif
+
+    BVHRay(const glm::vec3& ray_origin, const glm::vec3& ray_direction)
+        : origin(ray_origin), direction(ray_direction), inv_direction(1.0f / ray_direction.x, 1.0f / ray_direction.y, 1.0f / ray_direction.z)
+    {
+#ifdef BVH_USE_SSE
+        origin4 = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+        inv_direction4 = _mm_set_ps(0.0f, inv_direction.z, inv_direction.y, inv_direction.x);
+#endif
+    }
+};
+
+// Distance at which the ray enters the node's box grown by expand, FLT_MAX when it misses before t_max
+inline float ray_box_distance(const BVHNode& node, const BVHRay& ray, float expand, float t_max)
+{
+#ifdef BVH_USE_SSE
+    // The fourth lane holds left_first/count bits and is ignored by the reductions below
+    __m128 grow = _mm_set1_ps(expand);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds_min), grow), ray.origin4), ray.inv_direction4);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(node.bounds_max), grow), ray.origin4), ray.inv_direction4);
+    __m128 near4 = _mm_min_ps(t1, t2);
+    __m128 far4 = _mm_max_ps(t1, t2);
+
+    __m128 near_t = _mm_max_ss(_mm_max_ss(near4, _mm_shuffle_ps(near4, near4, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(near4, near4, _MM_SHUFFLE(2, 2, 2, 2)));
+    __m128 far_t = _mm_min_ss(_mm_min_ss(far4, _mm_shuffle_ps(far4, far4, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(far4, far4, _MM_SHUFFLE(2, 2, 2, 2)));
+    float t_near = _mm_cvtss_f32(near_t);
+    float t_far = _mm_cvtss_f32(far_t);
+#else
+    float t_near = -FLT_MAX;
+    float t_far = FLT_MAX;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float t1 = (node.bounds_min[axis] - expand - ray.origin[axis]) * ray.inv_direction[axis];
+        float t2 = (node.bounds_max[axis] + expand - ray.origin[axis]) * ray.inv_direction[axis];
+        t_near = std::max(t_near, std::min(t1, t2));
+        t_far = std::min(t_far, std::max(t1, t2));
+    }
+#endif
+
+    if (t_far >= t_near && t_far > 0.0f && t_near < t_max)
+        return t_near;
+    return FLT_MAX;
+}
+
+// Nearest first traversal. leaf_test(first, count, t_max) tests a leaf and may shrink t_max
+template <typename LeafTest>
+void traverse_bvh(const std::vector<BVHNode>& nodes, const BVHRay& ray, float expand, float& t_max, LeafTest leaf_test)
+{
+    if (nodes.empty() || ray_box_distance(nodes[0], ray, expand, t_max) == FLT_MAX)
+        return;
+
+    // One entry per level at most, BVHBuilder keeps leaves within BVH_MAX_DEPTH
+    unsigned int stack[BVH_MAX_DEPTH];
+    int stack_size = 0;
+    unsigned int node_index = 0;
+    while (true)
+    {
+        const BVHNode& node = nodes[node_index];
+        if (node.count > 0)
+        {
+            leaf_test(node.left_first, node.count, t_max);
+        }
+        else
+        {
+            unsigned int near_child = node.left_first;
+            unsigned int far_child = node.left_first + 1;
+            float near_t = ray_box_distance(nodes[near_child], ray, expand, t_max);
+            float far_t = ray_box_distance(nodes[far_child], ray, expand, t_max);
+            if (far_t < near_t)
             {
-                ss >> vertexStr;
-                std::istringstream vertexSS(vertexStr);
-                std::string posStr, texStr;
-                GLuint posIndex = 0, texIndex = 0;
+                std::swap(near_child, far_child);
+                std::swap(near_t, far_t);
+            }
 
-                // Parse position and texture (format: pos/tex)
-                if (std::getline(vertexSS, posStr, '/'))
+            if (near_t != FLT_MAX)
+            {
+                if (far_t != FLT_MAX)
+                    stack[stack_size++] = far_child;
+                node_index = near_child;
+                continue;
+            }
+        }
+
+        // Pop, skipping nodes that are now further than the closest hit
+        bool found = false;
+        while (stack_size > 0)
+        {
+            node_index = stack[--stack_size];
+            if (ray_box_distance(nodes[node_index], ray, expand, t_max) != FLT_MAX)
+            {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return;
+    }
+}
+
+// Binned SAH builder over primitive bounds. Reorders prims so every leaf is one range
+struct BVHBuilder
+{
+    const std::vector<glm::vec3>& prim_min;
+    const std::vector<glm::vec3>& prim_max;
+    std::vector<glm::vec3> centroids;
+    std::vector<BVHNode>& nodes;
+    std::vector<unsigned int>& prims;
+    std::atomic<unsigned int> node_count;
+
+    BVHBuilder(const std::vector<glm::vec3>& bounds_min, const std::vector<glm::vec3>& bounds_max, std::vector<BVHNode>& out_nodes, std::vector<unsigned int>& out_prims)
+        : prim_min(bounds_min), prim_max(bounds_max), nodes(out_nodes), prims(out_prims), node_count(1)
+    {
+    }
+
+    void build()
+    {
+        size_t count = prim_min.size();
+        prims.resize(count);
+        centroids.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            prims[i] = static_cast<unsigned int>(i);
+            centroids[i] = (prim_min[i] + prim_max[i]) * 0.5f;
+        }
+
+        nodes.clear();
+        if (count == 0)
+            return;
+
+        // A binary tree over N leaves never needs more than 2N - 1 nodes
+        nodes.resize(count * 2);
+        nodes[0].left_first = 0;
+        nodes[0].count = static_cast<unsigned int>(count);
+        update_bounds(0);
+
+        // Spread the first levels over the available threads
+        int parallel_depth = 0;
+        for (unsigned int threads = std::thread::hardware_concurrency(); threads > 1; threads /= 2)
+            parallel_depth++;
+        subdivide(0, 0, parallel_depth);
+
+        nodes.resize(node_count);
+        nodes.shrink_to_fit();
+    }
+
+    void update_bounds(unsigned int node_index)
+    {
+        BVHNode& node = nodes[node_index];
+        glm::vec3 bounds_min(FLT_MAX);
+        glm::vec3 bounds_max(-FLT_MAX);
+        for (unsigned int i = node.left_first; i < node.left_first + node.count; ++i)
+        {
+            bounds_min = glm::min(bounds_min, prim_min[prims[i]]);
+            bounds_max = glm::max(bounds_max, prim_max[prims[i]]);
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            node.bounds_min[axis] = bounds_min[axis];
+            node.bounds_max[axis] = bounds_max[axis];
+        }
+    }
+
+    static float surface_area(const glm::vec3& bounds_min, const glm::vec3& bounds_max)
+    {
+        glm::vec3 extent = bounds_max - bounds_min;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    // Levels a median split needs to bring count primitives down to one per leaf
+    static int median_depth(unsigned int count)
+    {
+        int levels = 0;
+        for (unsigned int remaining = count - 1; remaining > 0; remaining >>= 1)
+            levels++;
+        return levels;
+    }
+
+    void subdivide(unsigned int node_index, int depth, int parallel_depth)
+    {
+        BVHNode& node = nodes[node_index];
+        unsigned int first = node.left_first;
+        unsigned int count = node.count;
+        if (count <= 1)
+            return;
+
+        // SAH gives no balance guarantee. Once a lopsided split could push leaves past
+        // BVH_MAX_DEPTH, split at the median, which halves the count on every level
+        bool force_median = depth + 1 + median_depth(count) > BVH_MAX_DEPTH;
+
+        // Bins are laid over the centroid bounds, not the node bounds
+        glm::vec3 centroid_min(FLT_MAX);
+        glm::vec3 centroid_max(-FLT_MAX);
+        for (unsigned int i = first; i < first + count; ++i)
+        {
+            centroid_min = glm::min(centroid_min, centroids[prims[i]]);
+            centroid_max = glm::max(centroid_max, centroids[prims[i]]);
+        }
+
+        int best_axis = -1;
+        int best_split = 0;
+        float best_cost = FLT_MAX;
+        for (int axis = 0; axis < 3 && !force_median; ++axis)
+        {
+            float extent = centroid_max[axis] - centroid_min[axis];
+            if (extent <= 0.0f)
+                continue;
+
+            glm::vec3 bin_min[BVH_BINS];
+            glm::vec3 bin_max[BVH_BINS];
+            unsigned int bin_count[BVH_BINS] = {};
+            for (int b = 0; b < BVH_BINS; ++b)
+            {
+                bin_min[b] = glm::vec3(FLT_MAX);
+                bin_max[b] = glm::vec3(-FLT_MAX);
+            }
+
+            float bin_scale = BVH_BINS / extent;
+            for (unsigned int i = first; i < first + count; ++i)
+            {
+                unsigned int prim = prims[i];
+                int b = std::min(BVH_BINS - 1, static_cast<int>((centroids[prim][axis] - centroid_min[axis]) * bin_scale));
+                bin_count[b]++;
+                bin_min[b] = glm::min(bin_min[b], prim_min[prim]);
+                bin_max[b] = glm::max(bin_max[b], prim_max[prim]);
+            }
+
+            // Sweep from both sides to get the area and count left and right of each plane
+            float left_area[BVH_BINS - 1];
+            unsigned int left_count[BVH_BINS - 1];
+            glm::vec3 sweep_min(FLT_MAX);
+            glm::vec3 sweep_max(-FLT_MAX);
+            unsigned int sweep_count = 0;
+            for (int b = 0; b < BVH_BINS - 1; ++b)
+            {
+                sweep_count += bin_count[b];
+                if (bin_count[b] > 0)
                 {
-                    posIndex = std::stoi(posStr);
+                    sweep_min = glm::min(sweep_min, bin_min[b]);
+                    sweep_max = glm::max(sweep_max, bin_max[b]);
                 }
-                if (std::getline(vertexSS, texStr, '/'))
+                left_count[b] = sweep_count;
+                left_area[b] = sweep_count > 0 ? surface_area(sweep_min, sweep_max) : 0.0f;
+            }
+
+            sweep_min = glm::vec3(FLT_MAX);
+            sweep_max = glm::vec3(-FLT_MAX);
+            sweep_count = 0;
+            for (int b = BVH_BINS - 1; b > 0; --b)
+            {
+                sweep_count += bin_count[b];
+                if (bin_count[b] > 0)
                 {
-                    if (!texStr.empty())
-                        texIndex = std::stoi(texStr);
+                    sweep_min = glm::min(sweep_min, bin_min[b]);
+                    sweep_max = glm::max(sweep_max, bin_max[b]);
                 }
 
-                if (posIndex == 0)
+                unsigned int right_count = sweep_count;
+                if (left_count[b - 1] == 0 || right_count == 0)
+                    continue;
+
+                float cost = left_area[b - 1] * left_count[b - 1] + surface_area(sweep_min, sweep_max) * right_count;
+                if (cost < best_cost)
                 {
-                    std::cerr << "Error: Invalid face format in file " << filePath << "\n";
-                    return false;
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b;
+                }
+            }
+        }
+
+        // Keep small leaves when visiting two children would cost more than testing every triangle
+        if (count <= BVH_MAX_LEAF_SIZE)
+        {
+            if (force_median || best_axis == -1)
+                return;
+            glm::vec3 node_min(node.bounds_min[0], node.bounds_min[1], node.bounds_min[2]);
+            glm::vec3 node_max(node.bounds_max[0], node.bounds_max[1], node.bounds_max[2]);
+            float split_cost = BVH_TRAVERSAL_COST + BVH_INTERSECTION_COST * best_cost / surface_area(node_min, node_max);
+            if (split_cost >= BVH_INTERSECTION_COST * count)
+                return;
+        }
+
+        unsigned int* begin = &prims[first];
+        unsigned int* end = begin + count;
+        unsigned int* middle;
+        if (force_median)
+        {
+            glm::vec3 extent = centroid_max - centroid_min;
+            int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+            middle = begin + count / 2;
+            std::nth_element(begin, middle, end, [&](unsigned int a, unsigned int b)
+                {
+                    return centroids[a][axis] < centroids[b][axis];
+                });
+        }
+        else if (best_axis != -1)
+        {
+            float bin_scale = BVH_BINS / (centroid_max[best_axis] - centroid_min[best_axis]);
+            middle = std::partition(begin, end, [&](unsigned int prim)
+                {
+                    int b = std::min(BVH_BINS - 1, static_cast<int>((centroids[prim][best_axis] - centroid_min[best_axis]) * bin_scale));
+                    return b < best_split;
+                });
+        }
+        else
+        {
+            // All centroids coincide, split by count so leaves stay small
+            middle = begin + count / 2;
+        }
+
+        unsigned int left_size = static_cast<unsigned int>(middle - begin);
+        unsigned int left_index = node_count.fetch_add(2);
+        nodes[left_index].left_first = first;
+        nodes[left_index].count = left_size;
+        nodes[left_index + 1].left_first = first + left_size;
+        nodes[left_index + 1].count = count - left_size;
+        node.left_first = left_index;
+        node.count = 0;
+
+        update_bounds(left_index);
+        update_bounds(left_index + 1);
+
+        if (parallel_depth > 0 && count > BVH_PARALLEL_THRESHOLD)
+        {
+            std::thread left_thread(&BVHBuilder::subdivide, this, left_index, depth + 1, parallel_depth - 1);
+            subdivide(left_index + 1, depth + 1, parallel_depth - 1);
+            left_thread.join();
+        }
+        else
+        {
+            subdivide(left_index, depth + 1, 0);
+            subdivide(left_index + 1, depth + 1, 0);
+        }
+    }
+};
+
+struct BVHTriangle
+{
+    glm::vec3 v0;
+    glm::vec3 v1;
+    glm::vec3 v2;
+};
+
+// Moller-Trumbore. Works with unnormalized directions, distance is then in direction units
+inline bool ray_triangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float& distance)
+{
+    glm::vec3 edge1 = v1 - v0;
+    glm::vec3 edge2 = v2 - v0;
+    glm::vec3 p = glm::cross(direction, edge2);
+    float det = glm::dot(edge1, p);
+    if (std::fabs(det) < 1e-12f)
+        return false;
+
+    float inv_det = 1.0f / det;
+    glm::vec3 s = origin - v0;
+    float u = glm::dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    glm::vec3 q = glm::cross(s, edge1);
+    float v = glm::dot(direction, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    distance = glm::dot(edge2, q) * inv_det;
+    return distance > 0.0f;
+}
+
+// Ray against a capsule around segment a-b. The direction must be normalized
+inline bool ray_capsule(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, float radius, float& distance)
+{
+    glm::vec3 ba = b - a;
+    glm::vec3 oa = origin - a;
+    float baba = glm::dot(ba, ba);
+    float bard = glm::dot(ba, direction);
+    float baoa = glm::dot(ba, oa);
+    float rdoa = glm::dot(direction, oa);
+    float oaoa = glm::dot(oa, oa);
+
+    // Cylinder body
+    float qa = baba - bard * bard;
+    float qb = baba * rdoa - baoa * bard;
+    float qc = baba * oaoa - baoa * baoa - radius * radius * baba;
+    if (qa > 1e-12f)
+    {
+        float h = qb * qb - qa * qc;
+        if (h < 0.0f)
+            return false;
+
+        float t = (-qb - std::sqrt(h)) / qa;
+        float y = baoa + t * bard;
+        if (y > 0.0f && y < baba)
+        {
+            distance = t;
+            return t > 0.0f;
+        }
+    }
+
+    // End caps
+    bool hit = false;
+    const glm::vec3 ends[2] = { a, b };
+    for (const glm::vec3& end : ends)
+    {
+        glm::vec3 oc = origin - end;
+        float cb = glm::dot(direction, oc);
+        float cc = glm::dot(oc, oc) - radius * radius;
+        float h = cb * cb - cc;
+        if (h < 0.0f)
+            continue;
+
+        float t = -cb - std::sqrt(h);
+        if (t > 0.0f && (!hit || t < distance))
+        {
+            distance = t;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+// Sphere moving along a normalized direction against a triangle: ray against the
+// triangle grown by radius, which is two offset triangles plus a capsule per edge
+inline bool sweep_sphere_triangle(const glm::vec3& origin, const glm::vec3& direction, float radius, const BVHTriangle& triangle, float& distance)
+{
+    bool hit = false;
+    float t;
+
+    glm::vec3 normal = glm::cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0);
+    float normal_length = glm::length(normal);
+    if (normal_length > 0.0f)
+    {
+        glm::vec3 offset = normal * (radius / normal_length);
+        for (float side = -1.0f; side <= 1.0f; side += 2.0f)
+        {
+            if (ray_triangle(origin, direction, triangle.v0 + offset * side, triangle.v1 + offset * side, triangle.v2 + offset * side, t) && (!hit || t < distance))
+            {
+                distance = t;
+                hit = true;
+            }
+        }
+    }
+
+    const glm::vec3* corners[3] = { &triangle.v0, &triangle.v1, &triangle.v2 };
+    for (int edge = 0; edge < 3; ++edge)
+    {
+        if (ray_capsule(origin, direction, *corners[edge], *corners[(edge + 1) % 3], radius, t) && (!hit || t < distance))
+        {
+            distance = t;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+// Triangle BVH of one mesh in model space. Keeps positions once per vertex and indices per
+// triangle rather than three corners per triangle, so shared vertices are not repeated
+struct MeshBVH
+{
+    std::vector<BVHNode> nodes;
+    std::vector<glm::vec3> positions;
+    std::vector<GLuint> triangle_indices;   // Three per triangle, in leaf order
+
+    void build(const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices)
+    {
+        positions.resize(vertices.size() / 5);
+        for (size_t v = 0; v < positions.size(); ++v)
+        {
+            positions[v] = glm::vec3(vertices[v * 5], vertices[v * 5 + 1], vertices[v * 5 + 2]);
+        }
+        positions.shrink_to_fit();
+
+        size_t triangle_count = indices.size() / 3;
+        std::vector<glm::vec3> bounds_min(triangle_count);
+        std::vector<glm::vec3> bounds_max(triangle_count);
+        for (size_t t = 0; t < triangle_count; ++t)
+        {
+            BVHTriangle source = triangle(&indices[t * 3]);
+            bounds_min[t] = glm::min(source.v0, glm::min(source.v1, source.v2));
+            bounds_max[t] = glm::max(source.v0, glm::max(source.v1, source.v2));
+        }
+
+        std::vector<unsigned int> prims;
+        BVHBuilder builder(bounds_min, bounds_max, nodes, prims);
+        builder.build();
+
+        triangle_indices.resize(triangle_count * 3);
+        triangle_indices.shrink_to_fit();
+        for (size_t i = 0; i < prims.size(); ++i)
+        {
+            std::copy(&indices[prims[i] * 3], &indices[prims[i] * 3] + 3, &triangle_indices[i * 3]);
+        }
+    }
+
+    BVHTriangle triangle(const GLuint* corners) const
+    {
+        BVHTriangle result = { positions[corners[0]], positions[corners[1]], positions[corners[2]] };
+        return result;
+    }
+
+    // distance holds the maximum on input and the closest hit on output
+    bool intersect_ray(const glm::vec3& origin, const glm::vec3& direction, float& distance) const
+    {
+        bool hit = false;
+        BVHRay ray(origin, direction);
+        traverse_bvh(nodes, ray, 0.0f, distance, [&](unsigned int first, unsigned int count, float& t_max)
+            {
+                for (unsigned int i = first; i < first + count; ++i)
+                {
+                    float t;
+                    BVHTriangle tri = triangle(&triangle_indices[i * 3]);
+                    if (ray_triangle(origin, direction, tri.v0, tri.v1, tri.v2, t) && t < t_max)
+                    {
+                        t_max = t;
+                        hit = true;
+                    }
+                }
+            });
+        return hit;
+    }
+
+    // Direction must be normalized. distance holds the travel on input and the contact on output
+    bool sweep_sphere(const glm::vec3& origin, const glm::vec3& direction, float radius, float& distance) const
+    {
+        bool hit = false;
+        BVHRay ray(origin, direction);
+        traverse_bvh(nodes, ray, radius, distance, [&](unsigned int first, unsigned int count, float& t_max)
+            {
+                for (unsigned int i = first; i < first + count; ++i)
+                {
+                    float t;
+                    if (sweep_sphere_triangle(origin, direction, radius, triangle(&triangle_indices[i * 3]), t) && t < t_max)
+                    {
+                        t_max = t;
+                        hit = true;
+                    }
                 }
+            });
+        return hit;
+    }
+
+    size_t memory_bytes() const
+    {
+        return nodes.capacity() * sizeof(BVHNode) + positions.capacity() * sizeof(glm::vec3) + triangle_indices.capacity() * sizeof(GLuint);
+    }
+};
+
+struct BVHInstance
+{
+    const MeshBVH* mesh;
+    glm::mat4 world_matrix;
+    glm::mat4 inverse_matrix;
+    float scale;        // Uniform scale of world_matrix, sweeps assume no shear or stretch
+    int id;             // Returned by queries, e.g. the model index
+};
+
+// Top level BVH over mesh instances placed by their world matrices
+struct SceneBVH
+{
+    std::vector<BVHNode> nodes;
+    std::vector<BVHInstance> instances;     // In leaf order
+
+    void build(const std::vector<BVHInstance>& source)
+    {
+        std::vector<glm::vec3> bounds_min(source.size(), glm::vec3(FLT_MAX));
+        std::vector<glm::vec3> bounds_max(source.size(), glm::vec3(-FLT_MAX));
+        for (size_t i = 0; i < source.size(); ++i)
+        {
+            if (source[i].mesh->nodes.empty())
+                continue;
+
+            // World box around the eight corners of the mesh root box
+            const BVHNode& root = source[i].mesh->nodes[0];
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                glm::vec4 local((corner & 1) ? root.bounds_max[0] : root.bounds_min[0],
+                    (corner & 2) ? root.bounds_max[1] : root.bounds_min[1],
+                    (corner & 4) ? root.bounds_max[2] : root.bounds_min[2], 1.0f);
+                glm::vec3 world = glm::vec3(source[i].world_matrix * local);
+                bounds_min[i] = glm::min(bounds_min[i], world);
+                bounds_max[i] = glm::max(bounds_max[i], world);
+            }
+        }
+
+        std::vector<unsigned int> prims;
+        BVHBuilder builder(bounds_min, bounds_max, nodes, prims);
+        builder.build();
+
+        instances.resize(source.size());
+        for (size_t i = 0; i < prims.size(); ++i)
+        {
+            instances[i] = source[prims[i]];
+        }
+    }
+
+    static BVHInstance make_instance(const MeshBVH* mesh, const glm::mat4& world_matrix, int id)
+    {
+        BVHInstance instance;
+        instance.mesh = mesh;
+        instance.world_matrix = world_matrix;
+        instance.inverse_matrix = glm::inverse(world_matrix);
+        instance.scale = glm::length(glm::vec3(world_matrix[0]));
+        instance.id = id;
+        return instance;
+    }
+
+    // Closest instance along the ray. distance holds the maximum on input and the hit on output
+    bool pick(const glm::vec3& origin, const glm::vec3& direction, float& distance, int& id) const
+    {
+        bool hit = false;
+        BVHRay ray(origin, direction);
+        traverse_bvh(nodes, ray, 0.0f, distance, [&](unsigned int first, unsigned int count, float& t_max)
+            {
+                for (unsigned int i = first; i < first + count; ++i)
+                {
+                    // Unnormalized local direction keeps distances comparable across instances
+                    const BVHInstance& instance = instances[i];
+                    glm::vec3 local_origin = glm::vec3(instance.inverse_matrix * glm::vec4(origin, 1.0f));
+                    glm::vec3 local_direction = glm::vec3(instance.inverse_matrix * glm::vec4(direction, 0.0f));
+                    if (instance.mesh->intersect_ray(local_origin, local_direction, t_max))
+                    {
+                        id = instance.id;
+                        hit = true;
+                    }
+                }
+            });
+        return hit;
+    }
+
+    // Sphere moving along a normalized direction. distance holds the travel on input and the contact on output
+    bool sweep_sphere(const glm::vec3& origin, const glm::vec3& direction, float radius, float& distance) const
+    {
+        bool hit = false;
+        BVHRay ray(origin, direction);
+        traverse_bvh(nodes, ray, radius, distance, [&](unsigned int first, unsigned int count, float& t_max)
+            {
+                for (unsigned int i = first; i < first + count; ++i)
+                {
+                    const BVHInstance& instance = instances[i];
+                    glm::vec3 local_origin = glm::vec3(instance.inverse_matrix * glm::vec4(origin, 1.0f));
+                    glm::vec3 local_direction = glm::normalize(glm::vec3(instance.inverse_matrix * glm::vec4(direction, 0.0f)));
+                    float local_distance = t_max / instance.scale;
+                    if (instance.mesh->sweep_sphere(local_origin, local_direction, radius / instance.scale, local_distance))
+                    {
+                        t_max = local_distance * instance.scale;
+                        hit = true;
+                    }
+                }
+            });
+        return hit;
+    }
+};
+
+// Model Structure
+// ------------------
+struct Model
+{
+    // Read every draw
+    glm::mat4 model_matrix;     // Copied from the scene graph when the node moves
+    glm::vec3 color;    // Model colour
+    GLuint vao;
+    GLuint vbo;
+    GLuint ebo;
+    GLsizei index_count;
+    GLuint texture;    // ID. Equal to 0 if not present. Owned by whoever loaded it
+    glm::vec3 bounds_center;    // Bounding sphere in model space
+    float bounds_radius;
+    SceneNode scene_node;
+    MeshBVH bvh;                                // CPU copy of the triangles for picking and collision
+    bool closed;                                // Back faces are never seen, drawn with GL_CULL_FACE
+    std::vector<Meshlet> meshlets;              // Empty when the model is drawn in one call
+    std::vector<GLsizei> visible_counts;        // Index ranges that survived culling this frame
+    std::vector<const GLvoid*> visible_offsets;
+
+    // Debug information. Geometry itself only lives on the GPU after upload
+    std::string name;
+    std::string texture_name;
+    size_t vertex_count;
+
+    // Constructor
+    Model(const std::string name, const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices, const glm::vec3& col, const GLuint shader_prog, GLuint tex = 0, std::string tex_name = "", SceneNode node = NO_SCENE_NODE)
+        : model_matrix(1.0f), color(col), index_count(static_cast<GLsizei>(indices.size())), texture(tex), scene_node(node), closed(false),
+        name(name), texture_name(tex_name), vertex_count(vertices.size() / 5)
+    {
+        // VAO, VBO, EBO Initialization
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+
+        glBindVertexArray(vao);
+
+        // Vertex Buffer
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+        check_gl_error("VBO Setup");
+        gpu_memory.track_allocation(GPU_MEMORY_VERTEX_BUFFER, vbo, vertices.size() * sizeof(GLfloat), name);
+
+        // Element Buffer
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        check_gl_error("EBO Setup");
+        gpu_memory.track_allocation(GPU_MEMORY_INDEX_BUFFER, ebo, indices.size() * sizeof(GLuint), name);
+
+        // Positional attribute
+        GLint pos_attrib = glGetAttribLocation(shader_prog, "position");
+        if (pos_attrib == -1)
+        {
+            std::cerr << "Attribute 'position' not found in shader.\n";
+        }
+        glEnableVertexAttribArray(pos_attrib);
+        glVertexAttribPointer(pos_attrib, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)0); // 3 positions + 2 texcoords
+        check_gl_error("Vertex Position Attribute Setup");
+
+        // Texture Coordinate attribute
+        GLint tex_attrib = glGetAttribLocation(shader_prog, "texcoord");
+        if (tex_attrib == -1)
+        {
+            std::cerr << "Attribute 'texcoord' not found in shader.\n";
+        }
+        glEnableVertexAttribArray(tex_attrib);
+        glVertexAttribPointer(tex_attrib, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat))); // Positional offset
+        check_gl_error("Vertex TexCoord Attribute Setup");
+
+        glBindVertexArray(0);
+
+        label_gl_object(GL_VERTEX_ARRAY, vao, name + " VAO");
+        label_gl_object(GL_BUFFER, vbo, name + " VBO");
+        label_gl_object(GL_BUFFER, ebo, name + " EBO");
+
+        compute_bounds(vertices);
+    }
+
+    // Destructor
+    ~Model()
+    {
+        gpu_memory.track_release(GPU_MEMORY_VERTEX_BUFFER, vbo);
+        gpu_memory.track_release(GPU_MEMORY_INDEX_BUFFER, ebo);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    // Bounding sphere around the centre of the vertex AABB
+    void compute_bounds(const std::vector<GLfloat>& vertices)
+    {
+        bounds_center = glm::vec3(0.0f);
+        bounds_radius = 0.0f;
+        if (vertices.size() < 5)
+            return;
+
+        glm::vec3 min_pos(vertices[0], vertices[1], vertices[2]);
+        glm::vec3 max_pos = min_pos;
+        for (size_t i = 0; i + 2 < vertices.size(); i += 5)
+        {
+            glm::vec3 pos(vertices[i], vertices[i + 1], vertices[i + 2]);
+            min_pos = glm::min(min_pos, pos);
+            max_pos = glm::max(max_pos, pos);
+        }
+
+        bounds_center = (min_pos + max_pos) * 0.5f;
+        for (size_t i = 0; i + 2 < vertices.size(); i += 5)
+        {
+            glm::vec3 pos(vertices[i], vertices[i + 1], vertices[i + 2]);
+            bounds_radius = std::max(bounds_radius, glm::length(pos - bounds_center));
+        }
+    }
+
+    // Approximate height in pixels of the model's bounding sphere on screen
+    float screen_space_size(const glm::vec3& camera_pos, const glm::mat4& proj_matrix, float viewport_height) const
+    {
+        glm::vec3 world_center = glm::vec3(model_matrix * glm::vec4(bounds_center, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model_matrix[0])), std::max(glm::length(glm::vec3(model_matrix[1])), glm::length(glm::vec3(model_matrix[2]))));
+        float distance = std::max(glm::length(world_center - camera_pos), 0.01f);
+
+        // proj_matrix[1][1] is cot(fov / 2), which maps view space height to NDC
+        return bounds_radius * scale / distance * proj_matrix[1][1] * viewport_height;
+    }
+
+    // Collect index ranges of meshlets inside the frustum and facing the camera.
+    // Adjacent survivors are merged into one range. Returns the number of visible triangles
+    size_t cull_meshlets(const Frustum& frustum, const glm::vec3& camera_pos)
+    {
+        visible_counts.clear();
+        visible_offsets.clear();
+
+        // Whole model first, large static batches are mostly off screen
+        float scale = std::max(glm::length(glm::vec3(model_matrix[0])), std::max(glm::length(glm::vec3(model_matrix[1])), glm::length(glm::vec3(model_matrix[2]))));
+        if (!frustum.sphere_visible(glm::vec3(model_matrix * glm::vec4(bounds_center, 1.0f)), bounds_radius * scale))
+            return 0;
+        glm::vec3 local_camera = glm::vec3(glm::inverse(model_matrix) * glm::vec4(camera_pos, 1.0f));
+
+        size_t visible_indices = 0;
+        GLuint range_end = 0;
+        for (const Meshlet& meshlet : meshlets)
+        {
+            glm::vec3 world_center = glm::vec3(model_matrix * glm::vec4(meshlet.center, 1.0f));
+            if (!frustum.sphere_visible(world_center, meshlet.radius * scale))
+                continue;
+            if (enable_meshlet_cone_culling && meshlet.backfacing(local_camera))
+                continue;
+
+            if (!visible_counts.empty() && range_end == meshlet.index_offset)
+            {
+                visible_counts.back() += meshlet.index_count;
+            }
+            else
+            {
+                visible_counts.push_back(meshlet.index_count);
+                visible_offsets.push_back((void*)(meshlet.index_offset * sizeof(GLuint)));
+            }
+            range_end = meshlet.index_offset + meshlet.index_count;
+            visible_indices += meshlet.index_count;
+        }
+
+        return visible_indices / 3;
+    }
+
+    // Uniforms, texture and face culling shared by all draw paths
+    void set_uniforms(GLuint shader_program)
+    {
+        if (closed)
+            glEnable(GL_CULL_FACE);
+        else
+            glDisable(GL_CULL_FACE);
+
+        // Set model matrix
+        GLint uni_model = glGetUniformLocation(shader_program, "model_matrix");
+        if (uni_model == -1)
+        {
+            std::cerr << "Uniform 'model_matrix' not found.\n";
+        }
+        glUniformMatrix4fv(uni_model, 1, GL_FALSE, glm::value_ptr(model_matrix));
+
+        // Set model's color
+        GLint uni_color = glGetUniformLocation(shader_program, "model_color");
+        if (uni_color == -1)
+        {
+            std::cerr << "Uniform 'model_color' not found.\n";
+        }
+        glUniform3fv(uni_color, 1, glm::value_ptr(color));
+
+        // Set flag of using texture
+        GLint uni_use_texture = glGetUniformLocation(shader_program, "use_texture");
+        if (uni_use_texture == -1)
+        {
+            std::cerr << "Uniform 'use_texture' not found.\n";
+        }
+        glUniform1i(uni_use_texture, texture != 0 ? 1 : 0);
+
+        // Bind the texture if available
+        if (texture != 0)
+        {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            GLint uni_tex = glGetUniformLocation(shader_program, "tex");
+            if (uni_tex == -1)
+            {
+                std::cerr << "Uniform 'tex' not found.\n";
+            }
+            glUniform1i(uni_tex, 0);
+        }
+    }
+
+    // Model rendering function
+    void draw(GLuint shader_program)
+    {
+        set_uniforms(shader_program);
+
+        // Rendering
+        glBindVertexArray(vao);
+        if (!enable_meshlet_culling || meshlets.empty())
+        {
+            glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+        }
+        else if (!visible_counts.empty())
+        {
+            glMultiDrawElements(GL_TRIANGLES, visible_counts.data(), GL_UNSIGNED_INT, visible_offsets.data(), static_cast<GLsizei>(visible_counts.size()));
+        }
+        glBindVertexArray(0);
+        check_gl_error("Drawing Model");
+    }
+
+    // Whole mesh once per instance, multi-view shaders map each instance to a view
+    void draw_instanced(GLuint shader_program, GLsizei instance_count)
+    {
+        set_uniforms(shader_program);
+
+        glBindVertexArray(vao);
+        glDrawElementsInstanced(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0, instance_count);
+        glBindVertexArray(0);
+        check_gl_error("Drawing Model Instanced");
+    }
+};
+
+// Shapes
+// --------------------
+bool load_obj(const std::string& filePath, std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+{
+    std::ifstream file(filePath);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Cannot open file " << filePath << "\n";
+        return false;
+    }
+
+    std::vector<glm::vec3> temp_positions;
+    std::vector<glm::vec2> temp_texcoords;
+    std::vector<GLuint> temp_indices;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream ss(line);
+        std::string prefix;
+        ss >> prefix;
+
+        if (prefix == "v")
+        {
+            glm::vec3 position;
+            ss >> position.x >> position.y >> position.z;
+            temp_positions.push_back(position);
+        }
+        else if (prefix == "vt")
+        {
+            glm::vec2 texcoord;
+            ss >> texcoord.x >> texcoord.y;
+            temp_texcoords.push_back(texcoord);
+        }
+        else if (prefix == "f")
+        {
+            std::string vertexStr;
+            for (int i = 0; i < 3; ++i)
+            {
+                ss >> vertexStr;
+                std::istringstream vertexSS(vertexStr);
+                std::string posStr, texStr;
+                GLuint posIndex = 0, texIndex = 0;
+
+                // Parse position and texture (format: pos/tex)
+                if (std::getline(vertexSS, posStr, '/'))
+                {
+                    posIndex = std::stoi(posStr);
+                }
+                if (std::getline(vertexSS, texStr, '/'))
+                {
+                    if (!texStr.empty())
+                        texIndex = std::stoi(texStr);
+                }
+
+                if (posIndex == 0)
+                {
+                    std::cerr << "Error: Invalid face format in file " << filePath << "\n";
+                    return false;
+                }
+
+                // OBJ index starts from 1
+                temp_indices.push_back(posIndex - 1);
+
+                // Add texcoord to vertices
+                if (texIndex > 0 && texIndex <= temp_texcoords.size())
+                {
+                    vertices.push_back(temp_texcoords[texIndex - 1].x);
+                    vertices.push_back(temp_texcoords[texIndex - 1].y);
+                }
+                else
+                {
+                    // Set as default if no texcoord
+                    vertices.push_back(0.0f);
+                    vertices.push_back(0.0f);
+                }
+            }
+        }
+    }
+
+    // Move position to vertices including texcoords
+    std::vector<GLfloat> final_vertices;
+    for (size_t i = 0; i < temp_positions.size(); ++i)
+    {
+        final_vertices.push_back(temp_positions[i].x);
+        final_vertices.push_back(temp_positions[i].y);
+        final_vertices.push_back(temp_positions[i].z);
+        if (i < temp_texcoords.size())
+        {
+            final_vertices.push_back(temp_texcoords[i].x);
+            final_vertices.push_back(temp_texcoords[i].y);
+        }
+        else
+        {
+            final_vertices.push_back(0.0f);
+            final_vertices.push_back(0.0f);
+        }
+    }
+
+    vertices = final_vertices;
+    indices = temp_indices;
+    file.close();
+    return true;
+}
+
+// True when every edge is shared by exactly two triangles with opposite winding. Vertices are
+// matched by position, so UV seams do not open the mesh. Only closed meshes can have their back
+// faces culled, open ones show them through the holes
+bool is_closed_mesh(const std::vector<GLfloat>& vertices, const std::vector<GLuint>& indices)
+{
+    std::map<std::tuple<GLfloat, GLfloat, GLfloat>, GLuint> position_ids;
+    std::vector<GLuint> welded(vertices.size() / 5);
+    for (size_t v = 0; v < welded.size(); ++v)
+    {
+        auto key = std::make_tuple(vertices[v * 5], vertices[v * 5 + 1], vertices[v * 5 + 2]);
+        auto it = position_ids.insert(std::make_pair(key, static_cast<GLuint>(position_ids.size()))).first;
+        welded[v] = it->second;
+    }
+
+    // Each directed edge must appear reversed as often as it appears
+    std::vector<std::pair<GLuint, GLuint>> edges;
+    std::vector<std::pair<GLuint, GLuint>> reversed;
+    edges.reserve(indices.size());
+    reversed.reserve(indices.size());
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            GLuint a = welded[indices[t + corner]];
+            GLuint b = welded[indices[t + (corner + 1) % 3]];
+            edges.push_back(std::make_pair(a, b));
+            reversed.push_back(std::make_pair(b, a));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::sort(reversed.begin(), reversed.end());
+    return !edges.empty() && edges == reversed;
+}
+
+// Split the mesh into meshlets, reordering indices so each meshlet is one contiguous range.
+// Meshlets grow through triangles that add the fewest new vertices. Ties go to the triangle
+// closest to the meshlet, and with cone culling to the one facing most like it. When no
+// neighbour is left, the best scoring remaining triangle is used. Open meshes get no normal
+// cones, their back faces are visible
+std::vector<Meshlet> build_meshlets(const std::vector<GLfloat>& vertices, std::vector<GLuint>& indices, bool cone_culling)
+{
+    float cone_weight = cone_culling ? MESHLET_CONE_WEIGHT : 0.0f;
+    std::vector<Meshlet> meshlets;
+    std::vector<GLuint> meshlet_vertices;  // Unique vertices of the meshlet being built
+    std::vector<GLuint> ordered;           // Indices in meshlet order
+    ordered.reserve(indices.size());
+    size_t first_triangle = 0;
+
+    auto position = [&](GLuint index)
+    {
+        return glm::vec3(vertices[index * 5], vertices[index * 5 + 1], vertices[index * 5 + 2]);
+    };
+
+    auto finish_meshlet = [&](size_t end_triangle)
+    {
+        if (end_triangle == first_triangle)
+            return;
+
+        Meshlet meshlet;
+        meshlet.index_offset = static_cast<GLuint>(first_triangle * 3);
+        meshlet.index_count = static_cast<GLsizei>((end_triangle - first_triangle) * 3);
+
+        // Bounding sphere around the AABB centre
+        glm::vec3 min_pos = position(meshlet_vertices[0]);
+        glm::vec3 max_pos = min_pos;
+        for (GLuint index : meshlet_vertices)
+        {
+            min_pos = glm::min(min_pos, position(index));
+            max_pos = glm::max(max_pos, position(index));
+        }
+        meshlet.center = (min_pos + max_pos) * 0.5f;
+        meshlet.radius = 0.0f;
+        for (GLuint index : meshlet_vertices)
+        {
+            meshlet.radius = std::max(meshlet.radius, glm::length(position(index) - meshlet.center));
+        }
+
+        // Normal cone from the triangle normals
+        std::vector<glm::vec3> normals;
+        glm::vec3 normal_sum(0.0f);
+        for (size_t t = first_triangle; t < end_triangle; ++t)
+        {
+            glm::vec3 a = position(ordered[t * 3]);
+            glm::vec3 normal = glm::cross(position(ordered[t * 3 + 1]) - a, position(ordered[t * 3 + 2]) - a);
+            float length = glm::length(normal);
+            if (length <= 0.0f)
+                continue;   // Degenerate triangles face nowhere
+            normals.push_back(normal / length);
+            normal_sum += normal / length;
+        }
+
+        meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.cone_cos = -1.0f;
+        meshlet.cone_sin = 0.0f;
+        if (cone_culling && glm::length(normal_sum) > 0.0f)
+        {
+            meshlet.cone_axis = glm::normalize(normal_sum);
+            meshlet.cone_cos = 1.0f;
+            for (const glm::vec3& normal : normals)
+            {
+                meshlet.cone_cos = std::min(meshlet.cone_cos, glm::dot(meshlet.cone_axis, normal));
+            }
+            meshlet.cone_sin = std::sqrt(std::max(0.0f, 1.0f - meshlet.cone_cos * meshlet.cone_cos));
+        }
+
+        meshlets.push_back(meshlet);
+        meshlet_vertices.clear();
+        first_triangle = end_triangle;
+    };
+
+    size_t triangle_count = indices.size() / 3;
+    size_t vertex_count = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end()) + 1;
+
+    // Triangle centroids and unit normals for scoring candidates
+    std::vector<glm::vec3> triangle_centroids(triangle_count);
+    std::vector<glm::vec3> triangle_normals(triangle_count);
+    float area_sum = 0.0f;
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        glm::vec3 a = position(indices[t * 3]);
+        glm::vec3 b = position(indices[t * 3 + 1]);
+        glm::vec3 c = position(indices[t * 3 + 2]);
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        triangle_centroids[t] = (a + b + c) / 3.0f;
+        triangle_normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        area_sum += length * 0.5f;
+    }
+
+    // Radius a meshlet of MESHLET_MAX_TRIANGLES average triangles would have, distances are scaled by it
+    float expected_radius = triangle_count > 0 ? std::sqrt(area_sum / triangle_count * MESHLET_MAX_TRIANGLES) * 0.5f : 1.0f;
+    if (expected_radius <= 0.0f)
+        expected_radius = 1.0f;
+
+    // Of the triangles placed in the current meshlet
+    glm::vec3 centroid_sum(0.0f);
+    glm::vec3 normal_sum(0.0f);
+    glm::vec3 meshlet_center(0.0f);
+    glm::vec3 meshlet_axis(0.0f);   // Zero while the normals cancel out
+
+    // Triangles touching each vertex, as ranges of one shared list
+    std::vector<size_t> adjacency_offset(vertex_count + 1, 0);
+    for (GLuint index : indices)
+    {
+        adjacency_offset[index + 1]++;
+    }
+    for (size_t v = 0; v < vertex_count; ++v)
+    {
+        adjacency_offset[v + 1] += adjacency_offset[v];
+    }
+    std::vector<GLuint> adjacency(indices.size());
+    std::vector<size_t> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        adjacency[fill[indices[i]]++] = static_cast<GLuint>(i / 3);
+    }
+
+    std::vector<bool> assigned(triangle_count, false);
+    std::vector<size_t> vertex_meshlet(vertex_count, SIZE_MAX);   // Meshlet a vertex was last added to
+    size_t next_in_order = 0;
+
+    auto new_vertices = [&](size_t t)
+    {
+        size_t count = 0;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            if (vertex_meshlet[indices[t * 3 + corner]] != meshlets.size())
+                count++;
+        }
+        return count;
+    };
+
+    // Lower is better: distance from the meshlet centre, times how far the normal turns from its cone axis
+    auto score = [&](size_t t)
+    {
+        float distance = glm::length(triangle_centroids[t] - meshlet_center);
+        float spread = glm::dot(triangle_normals[t], meshlet_axis);
+        float cone = std::max(1.0f - spread * cone_weight, 0.001f);
+        return (1.0f + distance / expected_radius * (1.0f - cone_weight)) * cone;
+    };
+
+    // Unassigned neighbour of the meshlet adding the fewest new vertices, the best scoring one among equals
+    auto best_neighbour = [&](size_t& best, size_t& best_new)
+    {
+        float best_score = FLT_MAX;
+        for (GLuint vertex : meshlet_vertices)
+        {
+            for (size_t a = adjacency_offset[vertex]; a < adjacency_offset[vertex + 1]; ++a)
+            {
+                GLuint t = adjacency[a];
+                if (assigned[t])
+                    continue;
+
+                size_t count = new_vertices(t);
+                if (count > best_new)
+                    continue;
+                float t_score = score(t);
+                if (count < best_new || t_score < best_score)
+                {
+                    best = t;
+                    best_new = count;
+                    best_score = t_score;
+                }
+            }
+        }
+    };
+
+    // Best scoring of the next unassigned triangles in file order, when the meshlet has no neighbours left
+    auto best_remaining = [&]()
+    {
+        size_t best = triangle_count;
+        float best_score = FLT_MAX;
+        size_t scored = 0;
+        for (size_t t = next_in_order; t < triangle_count && scored < MESHLET_SEARCH_WINDOW; ++t)
+        {
+            if (assigned[t])
+                continue;
+            scored++;
+            float t_score = score(t);
+            if (t_score < best_score)
+            {
+                best = t;
+                best_score = t_score;
+            }
+        }
+        return best;
+    };
+
+    for (size_t placed = 0; placed < triangle_count; ++placed)
+    {
+        while (assigned[next_in_order])
+            next_in_order++;
+
+        size_t meshlet_triangles = placed - first_triangle;
+        size_t best = triangle_count;
+        size_t best_new = 3;
+        if (meshlet_triangles > 0)
+        {
+            best_neighbour(best, best_new);
+            if (best == triangle_count)
+                best = best_remaining();
+        }
+        if (best == triangle_count)
+            best = next_in_order;   // New meshlets start at the first remaining triangle in file order
+        best_new = new_vertices(best);
+
+        // A triangle facing away from the meshlet would widen its cone past any use
+        bool cone_split = false;
+        if (cone_culling && meshlet_triangles > 0 && meshlet_axis != glm::vec3(0.0f))
+            cone_split = glm::dot(triangle_normals[best], meshlet_axis) < MESHLET_CONE_SPLIT_COS;
+
+        if (meshlet_vertices.size() + best_new > MESHLET_MAX_VERTICES || meshlet_triangles >= MESHLET_MAX_TRIANGLES || cone_split)
+        {
+            finish_meshlet(placed);
+            meshlet_triangles = 0;
+            centroid_sum = glm::vec3(0.0f);
+            normal_sum = glm::vec3(0.0f);
+        }
+
+        assigned[best] = true;
+        centroid_sum += triangle_centroids[best];
+        normal_sum += triangle_normals[best];
+        meshlet_center = centroid_sum / static_cast<float>(meshlet_triangles + 1);
+        meshlet_axis = glm::length(normal_sum) > 0.0f ? glm::normalize(normal_sum) : glm::vec3(0.0f);
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            GLuint index = indices[best * 3 + corner];
+            ordered.push_back(index);
+            if (vertex_meshlet[index] != meshlets.size())
+            {
+                vertex_meshlet[index] = meshlets.size();
+                meshlet_vertices.push_back(index);
+            }
+        }
+    }
+    finish_meshlet(triangle_count);
+
+    indices.swap(ordered);
+    return meshlets;
+}
+
+GLuint load_texture(const std::string& file_path)
+{
+    // OpenGL want the texture to be flipped
+    stbi_set_flip_vertically_on_load(true);
+
+    // Store the number of channels
+    int width, height, nrChannels;
+
+    // Load the texture with stb image
+    unsigned char* data = stbi_load(file_path.c_str(), &width, &height, &nrChannels, 0);
+    if (!data)
+    {
+        std::cerr << "Failed to load texture: " << file_path << "\n";
+        return 0;
+    }
+
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+
+    // Set texture parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Red image's format
+    GLenum format;
+    if (nrChannels == 1)
+        format = GL_RED;
+    else if (nrChannels == 3)
+        format = GL_RGB;
+    else if (nrChannels == 4)
+        format = GL_RGBA;
+    else
+    {
+        std::cerr << "Unsupported number of channels (" << nrChannels << ") in texture: " << file_path << "\n";
+        stbi_image_free(data);
+        return 0;
+    }
+
+    // Pass texture data to OpenGL
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // Full mip chain adds roughly a third on top of the base level
+    size_t base_bytes = static_cast<size_t>(width) * height * nrChannels;
+    gpu_memory.track_allocation(GPU_MEMORY_TEXTURE, texture_id, base_bytes + base_bytes / 3, file_path);
+
+    // Free image memory
+    stbi_image_free(data);
+    glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture
+    label_gl_object(GL_TEXTURE, texture_id, file_path);
+
+    return texture_id;
+}
+
+// Static Batching
+// --------------------
+
+// Mesh that never moves after load, in the vertex layout produced by load_obj
+struct StaticMesh
+{
+    std::string name;
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+    glm::mat4 world_matrix;
+    glm::vec3 color;
+    GLuint texture;
+    std::string texture_name;
+};
+
+// World space geometry of static meshes sharing a material and a grid cell
+struct StaticBatch
+{
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+    glm::vec3 color;
+    GLuint texture;
+    std::string texture_name;
+    size_t mesh_count;
+};
+
+// Pre-transforms static meshes and merges them into batches that are drawn with one call each.
+// Meshes are bucketed by material and by the grid cell holding their bounds centre, so a mesh
+// is never split and every batch stays compact enough to be culled on its own
+std::vector<StaticBatch> merge_static_meshes(const std::vector<StaticMesh>& meshes)
+{
+    // Textured models ignore their colour, so only untextured ones are told apart by it
+    typedef std::tuple<GLuint, float, float, float, int, int, int> BatchKey;
+    std::map<BatchKey, size_t> open_batches;    // Batch still accepting meshes for each key
+    std::vector<StaticBatch> batches;
+    std::vector<glm::vec3> positions;
+
+    for (const StaticMesh& mesh : meshes)
+    {
+        size_t vertex_count = mesh.vertices.size() / 5;
+        if (vertex_count == 0)
+            continue;
+
+        glm::vec3 min_pos(FLT_MAX);
+        glm::vec3 max_pos(-FLT_MAX);
+        positions.resize(vertex_count);
+        for (size_t v = 0; v < vertex_count; ++v)
+        {
+            const GLfloat* vertex = &mesh.vertices[v * 5];
+            positions[v] = glm::vec3(mesh.world_matrix * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f));
+            min_pos = glm::min(min_pos, positions[v]);
+            max_pos = glm::max(max_pos, positions[v]);
+        }
+
+        glm::ivec3 cell = glm::ivec3(glm::floor((min_pos + max_pos) * 0.5f / STATIC_BATCH_CELL_SIZE));
+        glm::vec3 key_color = (mesh.texture != 0) ? glm::vec3(0.0f) : mesh.color;
+        BatchKey key(mesh.texture, key_color.r, key_color.g, key_color.b, cell.x, cell.y, cell.z);
+
+        auto it = open_batches.find(key);
+        if (it == open_batches.end() || batches[it->second].vertices.size() / 5 + vertex_count > STATIC_BATCH_MAX_VERTICES)
+        {
+            StaticBatch batch;
+            batch.color = mesh.color;
+            batch.texture = mesh.texture;
+            batch.texture_name = mesh.texture_name;
+            batch.mesh_count = 0;
+            batches.push_back(batch);
+            open_batches[key] = batches.size() - 1;
+        }
+
+        StaticBatch& batch = batches[open_batches[key]];
+        GLuint base_vertex = static_cast<GLuint>(batch.vertices.size() / 5);
+        for (size_t v = 0; v < vertex_count; ++v)
+        {
+            batch.vertices.push_back(positions[v].x);
+            batch.vertices.push_back(positions[v].y);
+            batch.vertices.push_back(positions[v].z);
+            batch.vertices.push_back(mesh.vertices[v * 5 + 3]);
+            batch.vertices.push_back(mesh.vertices[v * 5 + 4]);
+        }
+        for (GLuint index : mesh.indices)
+        {
+            batch.indices.push_back(base_vertex + index);
+        }
+        batch.mesh_count++;
+    }
+
+    return batches;
+}
+
+// Texture Residency
+// --------------------
+struct TextureMip
+{
+    int width;
+    int height;
+    std::vector<unsigned char> pixels;
+};
+
+struct ResidentTexture
+{
+    std::string name;
+    GLenum format;
+    int channels;
+    std::vector<TextureMip> mips;  // CPU copy of the full chain, level 0 is full resolution
+    int resident_level;            // Finest mip currently uploaded to the GPU
+    int min_level;                 // Coarsest level that never gets evicted
+    int requested_level;           // Finest mip asked for this frame
+    unsigned long last_used_frame;
+};
+
+// Streams mip levels of textures in and out of GPU memory.
+// Each frame, objects request the mip matching their size on screen. Textures grow
+// by one level at a time and, when the budget is exceeded, the least recently used
+// ones are dropped to coarser levels instead of failing to draw.
+struct TextureResidencyManager
+{
+    std::map<GLuint, ResidentTexture> textures;
+    size_t budget;
+    unsigned long frame = 0;
+
+    TextureResidencyManager(size_t memory_budget)
+        : budget(memory_budget)
+    {
+    }
+
+    GLuint load(const std::string& file_path)
+    {
+        stbi_set_flip_vertically_on_load(true);
+
+        int width, height, nrChannels;
+        unsigned char* data = stbi_load(file_path.c_str(), &width, &height, &nrChannels, 0);
+        if (!data)
+        {
+            std::cerr << "Failed to load texture: " << file_path << "\n";
+            return 0;
+        }
+
+        ResidentTexture texture;
+        texture.name = file_path;
+        texture.channels = nrChannels;
+        if (nrChannels == 1)
+            texture.format = GL_RED;
+        else if (nrChannels == 3)
+            texture.format = GL_RGB;
+        else if (nrChannels == 4)
+            texture.format = GL_RGBA;
+        else
+        {
+            std::cerr << "Unsupported number of channels (" << nrChannels << ") in texture: " << file_path << "\n";
+            stbi_image_free(data);
+            return 0;
+        }
+
+        // Keep the whole chain on the CPU so levels can be re-uploaded at will
+        TextureMip base;
+        base.width = width;
+        base.height = height;
+        base.pixels.assign(data, data + static_cast<size_t>(width) * height * nrChannels);
+        stbi_image_free(data);
+
+        texture.mips.push_back(base);
+        while (texture.mips.back().width > 1 || texture.mips.back().height > 1)
+        {
+            texture.mips.push_back(downsample(texture.mips.back(), nrChannels));
+        }
+
+        texture.min_level = 0;
+        while (texture.min_level + 1 < static_cast<int>(texture.mips.size())
+            && std::max(texture.mips[texture.min_level].width, texture.mips[texture.min_level].height) > TEXTURE_STREAMING_MIN_SIZE)
+        {
+            texture.min_level++;
+        }
+
+        // Start from the coarsest level and let requests stream in the detail
+        texture.resident_level = -1;
+        texture.requested_level = texture.min_level;
+        texture.last_used_frame = frame;
+
+        GLuint texture_id;
+        glGenTextures(1, &texture_id);
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        textures[texture_id] = texture;
+        upload(texture_id, textures[texture_id], texture.min_level);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        label_gl_object(GL_TEXTURE, texture_id, file_path);
+        check_gl_error("Texture Streaming Load");
+
+        return texture_id;
+    }
+
+    // Ask for the mip that matches an object covering screen_pixels on screen
+    void request(GLuint texture_id, float screen_pixels)
+    {
+        auto it = textures.find(texture_id);
+        if (it == textures.end())
+            return;
+
+        ResidentTexture& texture = it->second;
+        int level = texture.min_level;
+        if (screen_pixels > 0.0f)
+        {
+            float texels = static_cast<float>(std::max(texture.mips[0].width, texture.mips[0].height));
+            level = static_cast<int>(std::floor(std::log2(std::max(texels / screen_pixels, 1.0f))));
+            level = std::min(level, texture.min_level);
+        }
+
+        // Several objects can share one texture, the largest on screen wins
+        if (texture.last_used_frame != frame)
+            texture.requested_level = level;
+        else
+            texture.requested_level = std::min(texture.requested_level, level);
+        texture.last_used_frame = frame;
+    }
+
+    // Decide target levels against the budget and apply this frame's uploads.
+    // Returns true when a texture changed level
+    bool update()
+    {
+        // Textures nobody asked for keep what they have until memory is needed
+        std::map<GLuint, int> target;
+        for (auto& entry : textures)
+        {
+            ResidentTexture& texture = entry.second;
+            target[entry.first] = (texture.last_used_frame == frame)
+                ? std::min(texture.resident_level, texture.requested_level)
+                : texture.resident_level;
+        }
+
+        // Least recently used first, larger textures first on ties
+        std::vector<GLuint> eviction_order;
+        for (auto& entry : textures)
+        {
+            eviction_order.push_back(entry.first);
+        }
+        std::sort(eviction_order.begin(), eviction_order.end(), [&](GLuint a, GLuint b)
+            {
+                if (textures[a].last_used_frame != textures[b].last_used_frame)
+                    return textures[a].last_used_frame < textures[b].last_used_frame;
+                return chain_bytes(textures[a], target[a]) > chain_bytes(textures[b], target[b]);
+            });
+
+        // First drop detail nobody is looking at, then degrade visible textures
+        size_t total = 0;
+        for (auto& entry : target)
+        {
+            total += chain_bytes(textures[entry.first], entry.second);
+        }
+
+        for (int pass = 0; pass < 2 && total > budget; ++pass)
+        {
+            for (GLuint texture_id : eviction_order)
+            {
+                ResidentTexture& texture = textures[texture_id];
+                int floor_level = (pass == 0 && texture.last_used_frame == frame) ? texture.requested_level : texture.min_level;
+
+                while (total > budget && target[texture_id] < floor_level)
+                {
+                    total -= chain_bytes(texture, target[texture_id]);
+                    target[texture_id]++;
+                    total += chain_bytes(texture, target[texture_id]);
+                }
+            }
+        }
+
+        // Evictions apply at once, growth is rate limited to one level per upload
+        int uploads = 0;
+        bool changed = false;
+        for (auto& entry : textures)
+        {
+            int level = target[entry.first];
+            if (level > entry.second.resident_level)
+            {
+                upload(entry.first, entry.second, level);
+                changed = true;
+            }
+            else if (level < entry.second.resident_level && uploads < TEXTURE_UPLOADS_PER_FRAME)
+            {
+                upload(entry.first, entry.second, entry.second.resident_level - 1);
+                uploads++;
+                changed = true;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        check_gl_error("Texture Streaming Update");
+
+        frame++;
+        return changed;
+    }
+
+    void release_all()
+    {
+        for (auto& entry : textures)
+        {
+            GLuint texture_id = entry.first;
+            gpu_memory.track_release(GPU_MEMORY_TEXTURE, texture_id);
+            glDeleteTextures(1, &texture_id);
+        }
+        textures.clear();
+    }
+
+    void print_report() const
+    {
+        std::cout << "Texture residency (budget " << GpuMemoryTracker::to_megabytes(budget) << " MB):\n";
+        for (const auto& entry : textures)
+        {
+            const ResidentTexture& texture = entry.second;
+            const TextureMip& mip = texture.mips[texture.resident_level];
+            std::cout << "\t" << texture.name << "=" << mip.width << "x" << mip.height
+                << " (level " << texture.resident_level << ", requested " << texture.requested_level << ")\n";
+        }
+    }
+
+    // Bytes of the chain from level down to 1x1
+    static size_t chain_bytes(const ResidentTexture& texture, int level)
+    {
+        size_t bytes = 0;
+        for (size_t i = level; i < texture.mips.size(); ++i)
+        {
+            bytes += texture.mips[i].pixels.size();
+        }
+        return bytes;
+    }
+
+    // Re-specify the GL texture so that its base level is the given CPU mip
+    static void upload(GLuint texture_id, ResidentTexture& texture, int level)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // Rows of RGB mips are not 4 byte aligned
+
+        int gl_level = 0;
+        for (size_t i = level; i < texture.mips.size(); ++i, ++gl_level)
+        {
+            const TextureMip& mip = texture.mips[i];
+            glTexImage2D(GL_TEXTURE_2D, gl_level, texture.format, mip.width, mip.height, 0, texture.format, GL_UNSIGNED_BYTE, mip.pixels.data());
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, gl_level - 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        texture.resident_level = level;
+        gpu_memory.track_allocation(GPU_MEMORY_TEXTURE, texture_id, chain_bytes(texture, level), texture.name);
+    }
+
+    // 2x2 box filter, odd edges reuse the last row or column
+    static TextureMip downsample(const TextureMip& source, int channels)
+    {
+        TextureMip result;
+        result.width = std::max(source.width / 2, 1);
+        result.height = std::max(source.height / 2, 1);
+        result.pixels.resize(static_cast<size_t>(result.width) * result.height * channels);
+
+        for (int y = 0; y < result.height; ++y)
+        {
+            int y0 = std::min(y * 2, source.height - 1);
+            int y1 = std::min(y * 2 + 1, source.height - 1);
+            for (int x = 0; x < result.width; ++x)
+            {
+                int x0 = std::min(x * 2, source.width - 1);
+                int x1 = std::min(x * 2 + 1, source.width - 1);
+                for (int c = 0; c < channels; ++c)
+                {
+                    int sum = source.pixels[(static_cast<size_t>(y0) * source.width + x0) * channels + c]
+                        + source.pixels[(static_cast<size_t>(y0) * source.width + x1) * channels + c]
+                        + source.pixels[(static_cast<size_t>(y1) * source.width + x0) * channels + c]
+                        + source.pixels[(static_cast<size_t>(y1) * source.width + x1) * channels + c];
+                    result.pixels[(static_cast<size_t>(y) * result.width + x) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+
+        return result;
+    }
+};
+
+// Dynamic Resolution
+// --------------------
+
+// Renders the scene into an internal target whose size follows the measured GPU time.
+// The target is allocated once at the largest scale and frames use its lower left
+// corner, so changing resolution never reallocates. An upscale pass then fills the output.
+struct DynamicResolution
+{
+    GLuint fbo = 0;
+    GLuint color_texture = 0;
+    GLuint depth_renderbuffer = 0;
+    GLuint upscale_program = 0;
+    GLuint empty_vao = 0;          // Core profile needs a VAO bound even without attributes
+    int output_width = 0;
+    int output_height = 0;
+    int target_width = 0;          // Allocated size, output size at DRS_MAX_SCALE
+    int target_height = 0;
+    float scale = DRS_MAX_SCALE;
+
+    // GPU timing
+    GLuint queries[DRS_QUERY_COUNT] = {};
+    size_t query_begin = 0;        // Oldest query waiting for its result
+    size_t query_count = 0;        // Queries issued and not read yet
+    bool query_active = false;
+    float smoothed_ms = 0.0f;
+    bool has_sample = false;
+    int cooldown = 0;
+
+    bool init(int width, int height)
+    {
+        GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex_shader, 1, &upscale_vertex_source, NULL);
+        glCompileShader(vertex_shader);
+        GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment_shader, 1, &upscale_fragment_source, NULL);
+        glCompileShader(fragment_shader);
+
+        bool compiled = shader_compiled(vertex_shader, true, "Upscale Vertex") && shader_compiled(fragment_shader, true, "Upscale Fragment");
+        if (compiled)
+        {
+            upscale_program = glCreateProgram();
+            glAttachShader(upscale_program, vertex_shader);
+            glAttachShader(upscale_program, fragment_shader);
+            glBindFragDataLocation(upscale_program, 0, "outColor");
+            glLinkProgram(upscale_program);
+        }
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+
+        if (!compiled || !program_linked(upscale_program, true, "Upscale"))
+        {
+            glDeleteProgram(upscale_program);
+            upscale_program = 0;
+            return false;
+        }
+
+        label_gl_object(GL_PROGRAM, upscale_program, "Upscale");
+        glGenVertexArrays(1, &empty_vao);
+        glGenQueries(DRS_QUERY_COUNT, queries);
+        resize(width, height);
+        check_gl_error("Dynamic Resolution Setup");
+        return true;
+    }
+
+    void resize(int width, int height)
+    {
+        release_target();
+
+        output_width = width;
+        output_height = height;
+        target_width = std::max(1, static_cast<int>(std::ceil(width * DRS_MAX_SCALE)));
+        target_height = std::max(1, static_cast<int>(std::ceil(height * DRS_MAX_SCALE)));
+
+        glGenTextures(1, &color_texture);
+        glBindTexture(GL_TEXTURE_2D, color_texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, target_width, target_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenRenderbuffers(1, &depth_renderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, target_width, target_height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Dynamic resolution framebuffer is incomplete.\n";
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        check_gl_error("Dynamic Resolution Resize");
+
+        size_t target_bytes = static_cast<size_t>(target_width) * target_height * 4;
+        gpu_memory.track_allocation(GPU_MEMORY_RENDER_TARGET, color_texture, target_bytes, "Dynamic resolution target");
+        gpu_memory.track_allocation(GPU_MEMORY_RENDERBUFFER, depth_renderbuffer, target_bytes, "Dynamic resolution target");
+    }
+
+    int render_width() const
+    {
+        return std::max(1, static_cast<int>(output_width * scale));
+    }
+
+    int render_height() const
+    {
+        return std::max(1, static_cast<int>(output_height * scale));
+    }
+
+    // Bind the internal target at the current scale and start timing the frame
+    void begin_frame()
+    {
+        read_timings();
+
+        if (query_count < DRS_QUERY_COUNT)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, queries[(query_begin + query_count) % DRS_QUERY_COUNT]);
+            query_active = true;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, render_width(), render_height());
+    }
+
+    // Upscale into output_fbo, stop timing and let the controller pick the next scale.
+    // scene_program is bound again afterwards, scene uniforms are updated between frames
+    void end_frame(GLuint output_fbo, GLuint scene_program)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, output_fbo);
+        glViewport(0, 0, output_width, output_height);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+
+        glUseProgram(upscale_program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, color_texture);
+        glUniform1i(glGetUniformLocation(upscale_program, "scene"), 0);
+        glUniform2f(glGetUniformLocation(upscale_program, "uv_scale"),
+            static_cast<float>(render_width()) / target_width, static_cast<float>(render_height()) / target_height);
+        glUniform2f(glGetUniformLocation(upscale_program, "texel_size"), 1.0f / target_width, 1.0f / target_height);
+        glUniform1f(glGetUniformLocation(upscale_program, "sharpness"), scale < DRS_MAX_SCALE ? DRS_SHARPNESS : 0.0f);
+
+        glBindVertexArray(empty_vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+        glUseProgram(scene_program);
+        check_gl_error("Dynamic Resolution Upscale");
+
+        if (query_active)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            query_count++;
+            query_active = false;
+        }
+    }
+
+    // Consume finished timer queries without waiting on the ones still in flight
+    void read_timings()
+    {
+        while (query_count > 0)
+        {
+            GLuint query = queries[query_begin];
+            GLint available = 0;
+            glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                break;
+
+            GLuint64 elapsed_ns = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_ns);
+            query_begin = (query_begin + 1) % DRS_QUERY_COUNT;
+            query_count--;
+
+            float sample_ms = static_cast<float>(elapsed_ns) / 1000000.0f;
+            smoothed_ms = has_sample ? smoothed_ms + (sample_ms - smoothed_ms) * DRS_SMOOTHING : sample_ms;
+            has_sample = true;
+        }
+
+        update_scale();
+    }
+
+    void update_scale()
+    {
+        if (!has_sample)
+            return;
+        if (cooldown > 0)
+        {
+            cooldown--;
+            return;
+        }
+
+        float new_scale = scale;
+        if (smoothed_ms > DRS_TARGET_FRAME_MS * DRS_SCALE_DOWN_THRESHOLD)
+            new_scale = std::max(DRS_MIN_SCALE, scale - DRS_SCALE_STEP);
+        else if (smoothed_ms < DRS_TARGET_FRAME_MS * DRS_SCALE_UP_THRESHOLD)
+            new_scale = std::min(DRS_MAX_SCALE, scale + DRS_SCALE_STEP);
+
+        if (new_scale == scale)
+            return;
+
+        if (DRS_LOG_DECISIONS)
+        {
+            std::cout << "Dynamic resolution: GPU " << smoothed_ms << " ms (budget " << DRS_TARGET_FRAME_MS << " ms), scale "
+                << scale << " -> " << new_scale << " (" << static_cast<int>(output_width * new_scale) << "x" << static_cast<int>(output_height * new_scale) << ")\n";
+        }
+        scale = new_scale;
+        cooldown = DRS_COOLDOWN_FRAMES;
+    }
+
+    // Back to full resolution before the loop goes idle, so a reduced frame is not left on screen.
+    // The cooldown keeps the controller from lowering the scale right after the settle frame
+    void settle()
+    {
+        if (DRS_LOG_DECISIONS)
+        {
+            std::cout << "Dynamic resolution: idle, scale " << scale << " -> " << DRS_MAX_SCALE << "\n";
+        }
+        scale = DRS_MAX_SCALE;
+        cooldown = DRS_COOLDOWN_FRAMES;
+    }
+
+    void release_target()
+    {
+        if (fbo == 0)
+            return;
+
+        gpu_memory.track_release(GPU_MEMORY_RENDER_TARGET, color_texture);
+        gpu_memory.track_release(GPU_MEMORY_RENDERBUFFER, depth_renderbuffer);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color_texture);
+        glDeleteRenderbuffers(1, &depth_renderbuffer);
+        fbo = 0;
+    }
+
+    void release()
+    {
+        release_target();
+        glDeleteQueries(DRS_QUERY_COUNT, queries);
+        glDeleteVertexArrays(1, &empty_vao);
+        glDeleteProgram(upscale_program);
+    }
+};
+
+// Multi-View Rendering
+// --------------------
+
+// One view of a multi-view pass
+struct RenderView
+{
+    glm::mat4 view_proj;
+    glm::vec4 rect = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);  // Tile in NDC, xy = scale, zw = offset. Unused by layered passes
+};
+
+// Submits the scene once for up to MULTIVIEW_MAX_VIEWS views. Each model is culled against
+// every view and the surviving views become the instances of a single draw, so CPU cost
+// follows the number of models rather than views. Tiled passes squeeze each view into its
+// part of the viewport, layered passes send each view to a layer of a layered framebuffer.
+struct MultiViewRenderer
+{
+    GLuint tiled_program = 0;
+    GLuint layered_program = 0;
+
+    // Statistics of the last pass
+    size_t draw_calls = 0;
+    size_t view_instances = 0;      // Model and view pairs drawn
+    size_t culled_instances = 0;    // Model and view pairs rejected on the CPU
+
+    bool init(GLuint scene_program)
+    {
+        tiled_program = create_program(scene_program, false);
+        layered_program = create_program(scene_program, true);
+        check_gl_error("Multi-View Setup");
+        return tiled_program != 0 && layered_program != 0;
+    }
+
+    // Attributes are bound to the scene program's locations so model VAOs work with both
+    static GLuint create_program(GLuint scene_program, bool layered)
+    {
+        std::string header = "#version 150 core\n#define MAX_VIEWS " + std::to_string(MULTIVIEW_MAX_VIEWS) + "\n";
+        if (layered)
+            header += "#define LAYERED\n";
+        const GLchar* vertex_sources[2] = { header.c_str(), multiview_vertex_source };
+
+        GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex_shader, 2, vertex_sources, NULL);
+        glCompileShader(vertex_shader);
+        GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment_shader, 1, &fragment_source, NULL);
+        glCompileShader(fragment_shader);
+        bool compiled = shader_compiled(vertex_shader, true, "Multi-View Vertex") && shader_compiled(fragment_shader, true, "Multi-View Fragment");
+
+        GLuint geometry_shader = 0;
+        if (layered)
+        {
+            geometry_shader = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry_shader, 1, &multiview_geometry_source, NULL);
+            glCompileShader(geometry_shader);
+            compiled = compiled && shader_compiled(geometry_shader, true, "Multi-View Geometry");
+        }
+
+        GLuint program = 0;
+        if (compiled)
+        {
+            program = glCreateProgram();
+            glAttachShader(program, vertex_shader);
+            glAttachShader(program, fragment_shader);
+            if (geometry_shader != 0)
+                glAttachShader(program, geometry_shader);
+            glBindAttribLocation(program, glGetAttribLocation(scene_program, "position"), "position");
+            glBindAttribLocation(program, glGetAttribLocation(scene_program, "texcoord"), "texcoord");
+            glBindFragDataLocation(program, 0, "outColor");
+            glLinkProgram(program);
+        }
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        glDeleteShader(geometry_shader);
+
+        if (!compiled || !program_linked(program, true, layered ? "Multi-View Layered" : "Multi-View Tiled"))
+        {
+            glDeleteProgram(program);
+            return 0;
+        }
+        label_gl_object(GL_PROGRAM, program, layered ? "Multi-View Layered" : "Multi-View Tiled");
+        return program;
+    }
+
+    // Draws the models into every view. The caller binds and clears the target.
+    // Leaves the multi-view program bound
+    void draw(const std::vector<Model*>& models, const std::vector<RenderView>& views, bool layered)
+    {
+        draw_calls = 0;
+        view_instances = 0;
+        culled_instances = 0;
+
+        GLuint program = layered ? layered_program : tiled_program;
+        GLsizei view_count = static_cast<GLsizei>(std::min(views.size(), static_cast<size_t>(MULTIVIEW_MAX_VIEWS)));
+        if (program == 0 || view_count == 0)
+            return;
+
+        glm::mat4 view_proj[MULTIVIEW_MAX_VIEWS];
+        glm::vec4 rects[MULTIVIEW_MAX_VIEWS];
+        Frustum frustums[MULTIVIEW_MAX_VIEWS];
+        for (GLsizei v = 0; v < view_count; ++v)
+        {
+            view_proj[v] = views[v].view_proj;
+            rects[v] = views[v].rect;
+            frustums[v] = Frustum::from_matrix(views[v].view_proj);
+        }
+
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "view_proj"), view_count, GL_FALSE, glm::value_ptr(view_proj[0]));
+        glUniform4fv(glGetUniformLocation(program, "view_rect"), view_count, glm::value_ptr(rects[0]));
+        GLint uni_remap = glGetUniformLocation(program, "view_remap");
+        if (!layered)
+        {
+            for (int i = 0; i < 4; ++i)
+                glEnable(GL_CLIP_DISTANCE0 + i);
+        }
+
+        for (Model* model : models)
+        {
+            glm::vec3 world_center = glm::vec3(model->model_matrix * glm::vec4(model->bounds_center, 1.0f));
+            float scale = std::max(glm::length(glm::vec3(model->model_matrix[0])), std::max(glm::length(glm::vec3(model->model_matrix[1])), glm::length(glm::vec3(model->model_matrix[2]))));
+            float radius = model->bounds_radius * scale;
+
+            // Per-view culling merged into one list of views for this model
+            GLint remap[MULTIVIEW_MAX_VIEWS];
+            GLsizei visible = 0;
+            for (GLsizei v = 0; v < view_count; ++v)
+            {
+                if (frustums[v].sphere_visible(world_center, radius))
+                    remap[visible++] = v;
+            }
+            culled_instances += view_count - visible;
+            if (visible == 0)
+                continue;
+
+            glUniform1iv(uni_remap, visible, remap);
+            model->draw_instanced(program, visible);
+            draw_calls++;
+            view_instances += visible;
+        }
+
+        if (!layered)
+        {
+            for (int i = 0; i < 4; ++i)
+                glDisable(GL_CLIP_DISTANCE0 + i);
+        }
+        check_gl_error("Multi-View Draw");
+    }
+
+    void release()
+    {
+        glDeleteProgram(tiled_program);
+        glDeleteProgram(layered_program);
+    }
+};
+
+// Cubemap around a point, all six faces rendered by one layered multi-view pass
+struct ReflectionProbe
+{
+    GLuint fbo = 0;
+    GLuint color_cubemap = 0;
+    GLuint depth_cubemap = 0;
+
+    void init()
+    {
+        glGenTextures(1, &color_cubemap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, color_cubemap);
+        for (int face = 0; face < 6; ++face)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        // Layered attachments must all be layered, so depth is a cubemap too
+        glGenTextures(1, &depth_cubemap);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, depth_cubemap);
+        for (int face = 0; face < 6; ++face)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        GLint previous_fbo = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, color_cubemap, 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_cubemap, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Reflection probe framebuffer is incomplete.\n";
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+        check_gl_error("Reflection Probe Setup");
+
+        size_t cubemap_bytes = static_cast<size_t>(REFLECTION_PROBE_SIZE) * REFLECTION_PROBE_SIZE * 4 * 6;
+        gpu_memory.track_allocation(GPU_MEMORY_RENDER_TARGET, color_cubemap, cubemap_bytes, "Reflection probe");
+        gpu_memory.track_allocation(GPU_MEMORY_RENDER_TARGET, depth_cubemap, cubemap_bytes, "Reflection probe");
+    }
+
+    // Renders the faces seen from position. Framebuffer and viewport are restored afterwards
+    void capture(MultiViewRenderer& renderer, const std::vector<Model*>& models, const glm::vec3& position)
+    {
+        // Face order and orientation of GL_TEXTURE_CUBE_MAP_POSITIVE_X onwards, matching gl_Layer
+        static const glm::vec3 directions[6] = {
+            glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+            glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+        };
+        static const glm::vec3 ups[6] = {
+            glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+            glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+        };
+
+        glm::mat4 proj_matrix = glm::perspective(glm::radians(90.0f), 1.0f, 0.01f, 100.0f);
+        std::vector<RenderView> views(6);
+        for (int face = 0; face < 6; ++face)
+        {
+            views[face].view_proj = proj_matrix * glm::lookAt(position, position + directions[face], ups[face]);
+        }
+
+        GLint previous_fbo = 0;
+        GLint previous_viewport[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+        glGetIntegerv(GL_VIEWPORT, previous_viewport);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, REFLECTION_PROBE_SIZE, REFLECTION_PROBE_SIZE);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);    // Clears every layer
+        renderer.draw(models, views, true);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+        glViewport(previous_viewport[0], previous_viewport[1], previous_viewport[2], previous_viewport[3]);
+        check_gl_error("Reflection Probe Capture");
+    }
+
+    void release()
+    {
+        gpu_memory.track_release(GPU_MEMORY_RENDER_TARGET, color_cubemap);
+        gpu_memory.track_release(GPU_MEMORY_RENDER_TARGET, depth_cubemap);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color_cubemap);
+        glDeleteTextures(1, &depth_cubemap);
+    }
+};
+
+// Frame Capture
+// --------------------
+struct CaptureSlot
+{
+    GLuint pbo;
+    GLsync fence;           // Signalled once the readback into pbo has finished
+    unsigned long frame;
+};
+
+struct CapturedFrame
+{
+    unsigned long frame;
+    std::vector<unsigned char> pixels;  // RGBA as read back, bottom row first
+};
+
+// Reads frames back through a ring of pixel buffer objects so glReadPixels returns
+// without waiting for the GPU. Finished readbacks are copied out once their fence
+// signals and handed to writer threads that encode them to disk.
+struct FrameCapture
+{
+    int width = 0;
+    int height = 0;
+    std::vector<CaptureSlot> slots;
+    std::deque<size_t> in_flight;   // Slot indices in submission order
+    unsigned long next_frame = 0;
+
+    // Writer pool
+    std::vector<std::thread> workers;
+    std::deque<CapturedFrame> queue;
+    std::mutex queue_mutex;
+    std::condition_variable queue_ready;
+    bool stopping = false;
+
+    // Statistics
+    unsigned long captured = 0;     // Readbacks issued
+    unsigned long late = 0;         // Readbacks that were not finished when their slot was needed again
+    unsigned long dropped = 0;      // Frames discarded because the writers fell behind or a readback wait failed
+    std::atomic<unsigned long> written{ 0 };
+    std::atomic<unsigned long> write_errors{ 0 };
+    sf::Clock clock;
+
+    // Fails when CAPTURE_PATH cannot be created or written, before any frame is captured
+    bool init(int capture_width, int capture_height)
+    {
+#ifdef _WIN32
+        _mkdir(CAPTURE_PATH.c_str());
+#else
+        mkdir(CAPTURE_PATH.c_str(), 0755);
+#endif
+        std::string test_path = CAPTURE_PATH + ".write_test";
+        std::ofstream test_file(test_path, std::ios::binary);
+        if (!test_file.is_open())
+        {
+            std::cerr << "Frame capture: cannot write to " << CAPTURE_PATH << "\n";
+            return false;
+        }
+        test_file.close();
+        std::remove(test_path.c_str());
+
+        width = capture_width;
+        height = capture_height;
+
+        // GL rows start at the bottom. Writers flip while encoding, off the render thread
+        stbi_flip_vertically_on_write(1);
+
+        size_t frame_bytes = static_cast<size_t>(width) * height * 4;
+        slots.resize(CAPTURE_PBO_COUNT);
+        for (CaptureSlot& slot : slots)
+        {
+            glGenBuffers(1, &slot.pbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes, NULL, GL_STREAM_READ);
+            gpu_memory.track_allocation(GPU_MEMORY_PIXEL_BUFFER, slot.pbo, frame_bytes, "Frame capture");
+            slot.fence = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        check_gl_error("Frame Capture Setup");
+
+        for (size_t i = 0; i < CAPTURE_WORKER_THREADS; ++i)
+        {
+            workers.push_back(std::thread(&FrameCapture::worker_loop, this));
+        }
+        clock.restart();
+        return true;
+    }
+
+    // Queue a readback of the bound read framebuffer. Call after rendering, before display
+    void capture()
+    {
+        collect(false);
+
+        // All slots busy: the oldest readback has to finish before its buffer is reused
+        if (in_flight.size() == slots.size())
+        {
+            late++;
+            if (!collect_oldest(true))
+            {
+                // The wait failed and the slot is still in use, skip this frame rather than overwrite it
+                dropped++;
+                return;
+            }
+        }
+
+        size_t slot_index = next_frame % slots.size();
+        CaptureSlot& slot = slots[slot_index];
+        slot.frame = next_frame++;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);   // Into the PBO, returns immediately
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        check_gl_error("Frame Capture Readback");
+
+        in_flight.push_back(slot_index);
+        captured++;
+    }
+
+    // Hand over every readback that has finished, in order. With wait set, block for all of them
+    void collect(bool wait)
+    {
+        while (!in_flight.empty())
+        {
+            if (!collect_oldest(wait))
+                break;
+        }
+    }
+
+    bool collect_oldest(bool wait)
+    {
+        CaptureSlot& slot = slots[in_flight.front()];
+
+        GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+            return false;
+
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        in_flight.pop_front();
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (queue.size() >= CAPTURE_MAX_QUEUED_FRAMES)
+            {
+                dropped++;
+                return true;
+            }
+        }
+
+        // One straight copy, the writers flip rows while encoding
+        CapturedFrame frame;
+        frame.frame = slot.frame;
+        frame.pixels.resize(static_cast<size_t>(width) * height * 4);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        const unsigned char* data = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame.pixels.size(), GL_MAP_READ_BIT));
+        if (data)
+        {
+            memcpy(frame.pixels.data(), data, frame.pixels.size());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        check_gl_error("Frame Capture Map");
+
+        if (!data)
+            return true;
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            queue.push_back(std::move(frame));
+        }
+        queue_ready.notify_one();
+        return true;
+    }
+
+    void worker_loop()
+    {
+        while (true)
+        {
+            CapturedFrame frame;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                queue_ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            if (write_frame(frame))
+                written++;
+            else
+                write_errors++;
+        }
+    }
+
+    bool write_frame(const CapturedFrame& frame) const
+    {
+        std::string number = std::to_string(frame.frame);
+        std::string file_name = CAPTURE_PATH + "frame_" + std::string(6 - std::min<size_t>(number.size(), 6), '0') + number;
+
+        if (CAPTURE_WRITE_PNG)
+        {
+            return stbi_write_png((file_name + ".png").c_str(), width, height, 4, frame.pixels.data(), width * 4) != 0;
+        }
+
+        // Raw frames are stored top row first like the PNGs
+        std::ofstream file(file_name + "_" + std::to_string(width) + "x" + std::to_string(height) + ".rgba", std::ios::binary);
+        size_t row_bytes = static_cast<size_t>(width) * 4;
+        for (int y = height - 1; y >= 0; --y)
+        {
+            file.write(reinterpret_cast<const char*>(&frame.pixels[y * row_bytes]), row_bytes);
+        }
+        return file.good();
+    }
+
+    // Wait for outstanding readbacks and writes, then release everything
+    void finish()
+    {
+        collect(true);
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            stopping = true;
+        }
+        queue_ready.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+
+        for (CaptureSlot& slot : slots)
+        {
+            gpu_memory.track_release(GPU_MEMORY_PIXEL_BUFFER, slot.pbo);
+            glDeleteBuffers(1, &slot.pbo);
+        }
+        slots.clear();
+
+        float seconds = clock.getElapsedTime().asSeconds();
+        std::cout << SEPARATOR;
+        std::cout << "Frame capture: " << captured << " frames at " << width << "x" << height;
+        if (seconds > 0.0f)
+            std::cout << " (" << captured / seconds << " FPS)";
+        std::cout << "\n";
+        std::cout << "\twritten=" << written << "\n";
+        std::cout << "\tlate=" << late << "\n";
+        std::cout << "\tdropped=" << dropped << "\n";
+        if (write_errors > 0)
+            std::cout << "\twrite errors=" << write_errors << " (is " << CAPTURE_PATH << " writable?)\n";
+    }
+};
+
+// Benchmarks
+// --------------------
+void benchmark_scene_graph()
+{
+    std::cout << SEPARATOR;
+    std::cout << "Scene graph benchmark (" << SCENE_BENCHMARK_NODES << " nodes)\n";
+
+    // Eight children per node gives a hierarchy about seven levels deep
+    SceneGraph scene;
+    std::vector<SceneNode> nodes;
+    nodes.reserve(SCENE_BENCHMARK_NODES);
+    for (int i = 0; i < SCENE_BENCHMARK_NODES; ++i)
+    {
+        SceneNode parent_node = (i == 0) ? NO_SCENE_NODE : nodes[(i - 1) / 8];
+        nodes.push_back(scene.add_node(parent_node, glm::vec3(1.0f, 0.0f, 0.0f), glm::angleAxis(glm::radians(1.0f), glm::vec3(0.0f, 1.0f, 0.0f))));
+    }
 
-                // OBJ index starts from 1
-                temp_indices.push_back(posIndex - 1);
+    sf::Clock clock;
+    size_t updated = scene.update();
+    std::cout << "\tfull update: " << clock.restart().asMicroseconds() / 1000.0 << " ms (" << updated << " nodes)\n";
 
-                // Add texcoord to vertices
-                if (texIndex > 0 && texIndex <= temp_texcoords.size())
-                {
-                    vertices.push_back(temp_texcoords[texIndex - 1].x);
-                    vertices.push_back(temp_texcoords[texIndex - 1].y);
-                }
-                else
-                {
-                    // Set as default if no texcoord
-                    vertices.push_back(0.0f);
-                    vertices.push_back(0.0f);
-                }
-            }
-        }
+    // Scattered leaves, the nodes past the last one with children. They fill the last level and
+    // the end of the one above it, and make up most of the tree. Inner nodes would dirty whole
+    // subtrees, and the root would repeat the full update
+    int first_leaf = (SCENE_BENCHMARK_NODES - 1) / 8 + 1;
+    int dirty_step = std::max(1, (SCENE_BENCHMARK_NODES - first_leaf) / (SCENE_BENCHMARK_NODES / 100));
+    for (int i = first_leaf; i < SCENE_BENCHMARK_NODES; i += dirty_step)
+    {
+        scene.set_local_position(nodes[i], glm::vec3(2.0f, 0.0f, 0.0f));
     }
+    clock.restart();
+    updated = scene.update();
+    std::cout << "\t1% nodes dirty: " << clock.restart().asMicroseconds() / 1000.0 << " ms (" << updated << " nodes)\n";
 
-    // Move position to vertices including texcoords
-    std::vector<GLfloat> final_vertices;
-    for (size_t i = 0; i < temp_positions.size(); ++i)
+    // A subtree below the root
+    scene.set_local_position(nodes[1], glm::vec3(3.0f, 0.0f, 0.0f));
+    clock.restart();
+    updated = scene.update();
+    std::cout << "\tone subtree dirty: " << clock.restart().asMicroseconds() / 1000.0 << " ms (" << updated << " nodes)\n";
+
+    clock.restart();
+    updated = scene.update();
+    std::cout << "\tclean: " << clock.restart().asMicroseconds() / 1000.0 << " ms (" << updated << " nodes)\n";
+
+    std::cout << "\tmemory: " << static_cast<double>(scene.memory_bytes()) / scene.size() << " bytes per node\n";
+}
+
+void benchmark_bvh()
+{
+    std::cout << SEPARATOR;
+    std::cout << "BVH benchmark (" << BVH_BENCHMARK_TRIANGLES << " triangles x " << BVH_BENCHMARK_INSTANCES << " instances)\n";
+
+    // Rippled grid in the same vertex layout as load_obj produces
+    int grid = static_cast<int>(std::sqrt(BVH_BENCHMARK_TRIANGLES / 2.0));
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+    for (int z = 0; z <= grid; ++z)
     {
-        final_vertices.push_back(temp_positions[i].x);
-        final_vertices.push_back(temp_positions[i].y);
-        final_vertices.push_back(temp_positions[i].z);
-        if (i < temp_texcoords.size())
+        for (int x = 0; x <= grid; ++x)
         {
-            final_vertices.push_back(temp_texcoords[i].x);
-            final_vertices.push_back(temp_texcoords[i].y);
+            float u = static_cast<float>(x) / grid;
+            float v = static_cast<float>(z) / grid;
+            vertices.push_back(u * 10.0f);
+            vertices.push_back(std::sin(u * 40.0f) * std::cos(v * 40.0f) * 0.2f);
+            vertices.push_back(v * 10.0f);
+            vertices.push_back(u);
+            vertices.push_back(v);
         }
-        else
+    }
+    for (int z = 0; z < grid; ++z)
+    {
+        for (int x = 0; x < grid; ++x)
         {
-            final_vertices.push_back(0.0f);
-            final_vertices.push_back(0.0f);
+            GLuint corner = z * (grid + 1) + x;
+            GLuint quad[6] = { corner, corner + grid + 1, corner + 1, corner + 1, corner + grid + 1, corner + grid + 2 };
+            indices.insert(indices.end(), quad, quad + 6);
         }
     }
 
-    vertices = final_vertices;
-    indices = temp_indices;
-    file.close();
-    return true;
+    sf::Clock clock;
+    MeshBVH mesh;
+    mesh.build(vertices, indices);
+    std::cout << "\tmesh build: " << clock.restart().asMicroseconds() / 1000.0 << " ms (" << mesh.nodes.size() << " nodes, "
+        << GpuMemoryTracker::to_megabytes(mesh.memory_bytes()) << " MB)\n";
+
+    std::vector<BVHInstance> instances;
+    for (int i = 0; i < BVH_BENCHMARK_INSTANCES; ++i)
+    {
+        glm::mat4 world = glm::translate(glm::mat4(1.0f), glm::vec3(11.0f * (i % 2), 0.0f, 11.0f * (i / 2)));
+        instances.push_back(SceneBVH::make_instance(&mesh, world, i));
+    }
+    SceneBVH scene_bvh;
+    clock.restart();
+    scene_bvh.build(instances);
+    std::cout << "\tscene build: " << clock.restart().asMicroseconds() / 1000.0 << " ms\n";
+
+    // Rays from above towards random points on the instances
+    std::vector<glm::vec3> origins(BVH_BENCHMARK_RAYS);
+    std::vector<glm::vec3> directions(BVH_BENCHMARK_RAYS);
+    srand(1);
+    for (int i = 0; i < BVH_BENCHMARK_RAYS; ++i)
+    {
+        glm::vec3 target(static_cast<float>(rand()) / RAND_MAX * 21.0f, 0.0f, static_cast<float>(rand()) / RAND_MAX * 21.0f);
+        origins[i] = glm::vec3(static_cast<float>(rand()) / RAND_MAX * 21.0f, 5.0f, static_cast<float>(rand()) / RAND_MAX * 21.0f);
+        directions[i] = glm::normalize(target - origins[i]);
+    }
+
+    int hits = 0;
+    clock.restart();
+    for (int i = 0; i < BVH_BENCHMARK_RAYS; ++i)
+    {
+        float distance = FLT_MAX;
+        int id;
+        if (scene_bvh.pick(origins[i], directions[i], distance, id))
+            hits++;
+    }
+    double seconds = clock.restart().asMicroseconds() / 1000000.0;
+    std::cout << "\trays: " << BVH_BENCHMARK_RAYS / seconds / 1000000.0 << " Mrays/s, " << seconds * 1000000.0 / BVH_BENCHMARK_RAYS << " us per ray (" << hits << " hits)\n";
+
+    // Camera sized sweeps over a short step
+    int sweeps = BVH_BENCHMARK_RAYS / 10;
+    hits = 0;
+    clock.restart();
+    for (int i = 0; i < sweeps; ++i)
+    {
+        float distance = 5.0f;
+        if (scene_bvh.sweep_sphere(origins[i], directions[i], CAMERA_COLLISION_RADIUS, distance))
+            hits++;
+    }
+    seconds = clock.restart().asMicroseconds() / 1000000.0;
+    std::cout << "\tsphere sweeps: " << seconds * 1000000.0 / sweeps << " us per sweep (" << hits << " hits)\n";
 }
 
-GLuint load_texture(const std::string& file_path)
+void benchmark_static_batching()
 {
-    // OpenGL want the texture to be flipped
-    stbi_set_flip_vertically_on_load(true);
+    std::cout << SEPARATOR;
+    std::cout << "Static batching benchmark (" << STATIC_BATCH_BENCHMARK_PROPS << " props)\n";
 
-    // Store the number of channels
-    int width, height, nrChannels;
+    // Small boxes scattered over a square, four textures
+    const GLfloat box_vertices[] = {
+        -0.5f, 0.0f, -0.5f, 0.0f, 0.0f,   0.5f, 0.0f, -0.5f, 1.0f, 0.0f,   0.5f, 0.0f, 0.5f, 1.0f, 1.0f,   -0.5f, 0.0f, 0.5f, 0.0f, 1.0f,
+        -0.5f, 1.0f, -0.5f, 0.0f, 0.0f,   0.5f, 1.0f, -0.5f, 1.0f, 0.0f,   0.5f, 1.0f, 0.5f, 1.0f, 1.0f,   -0.5f, 1.0f, 0.5f, 0.0f, 1.0f
+    };
+    const GLuint box_indices[] = {
+        0, 2, 1, 0, 3, 2,   4, 5, 6, 4, 6, 7,   0, 1, 5, 0, 5, 4,
+        1, 2, 6, 1, 6, 5,   2, 3, 7, 2, 7, 6,   3, 0, 4, 3, 4, 7
+    };
+    float extent = std::sqrt(static_cast<float>(STATIC_BATCH_BENCHMARK_PROPS)) * 2.0f;
 
-    // Load the texture with stb image
-    unsigned char* data = stbi_load(file_path.c_str(), &width, &height, &nrChannels, 0);
-    if (!data)
+    std::vector<StaticMesh> meshes(STATIC_BATCH_BENCHMARK_PROPS);
+    srand(1);
+    for (int i = 0; i < STATIC_BATCH_BENCHMARK_PROPS; ++i)
     {
-        std::cerr << "Failed to load texture: " << file_path << "\n";
-        return 0;
+        glm::vec3 position(static_cast<float>(rand()) / RAND_MAX * extent, 0.0f, static_cast<float>(rand()) / RAND_MAX * extent);
+        float angle = static_cast<float>(rand()) / RAND_MAX * 360.0f;
+        meshes[i].name = "prop";
+        meshes[i].vertices.assign(box_vertices, box_vertices + 40);
+        meshes[i].indices.assign(box_indices, box_indices + 36);
+        meshes[i].world_matrix = glm::rotate(glm::translate(glm::mat4(1.0f), position), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
+        meshes[i].color = glm::vec3(1.0f);
+        meshes[i].texture = 1 + i % 4;
     }
 
-    GLuint texture_id;
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
+    sf::Clock clock;
+    std::vector<StaticBatch> batches = merge_static_meshes(meshes);
+    std::cout << "\tmerge: " << clock.restart().asMicroseconds() / 1000.0 << " ms\n";
+    std::cout << "\tdraw calls: " << meshes.size() << " -> " << batches.size() << "\n";
+
+    // Culling granularity from a camera at the edge looking across the props
+    glm::vec3 eye(extent * 0.5f, 1.7f, extent);
+    glm::mat4 view_proj = glm::perspective(glm::radians(45.0f), WINDOW_WIDTH / WINDOW_HEIGHT, 0.01f, 100.0f)
+        * glm::lookAt(eye, eye + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::from_matrix(view_proj);
+    size_t visible_props = 0;
+    for (const StaticMesh& mesh : meshes)
+    {
+        if (frustum.sphere_visible(glm::vec3(mesh.world_matrix[3]) + glm::vec3(0.0f, 0.5f, 0.0f), 0.87f))
+            visible_props++;
+    }
+    size_t visible_batches = 0;
+    size_t visible_batch_props = 0;
+    for (const StaticBatch& batch : batches)
+    {
+        glm::vec3 min_pos(FLT_MAX);
+        glm::vec3 max_pos(-FLT_MAX);
+        for (size_t v = 0; v < batch.vertices.size(); v += 5)
+        {
+            glm::vec3 pos(batch.vertices[v], batch.vertices[v + 1], batch.vertices[v + 2]);
+            min_pos = glm::min(min_pos, pos);
+            max_pos = glm::max(max_pos, pos);
+        }
+        if (frustum.sphere_visible((min_pos + max_pos) * 0.5f, glm::length(max_pos - min_pos) * 0.5f))
+        {
+            visible_batches++;
+            visible_batch_props += batch.mesh_count;
+        }
+    }
+    std::cout << "\tvisible: " << visible_props << " props as " << visible_props << " draws, batched " << visible_batch_props
+        << " props as " << visible_batches << " draws\n";
+}
 
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// Cost of error checking on a stream of small buffer updates: without checks and, in debug
+// builds, polling glGetError after each call or with the debug callback installed
+void benchmark_gl_checks()
+{
+    std::cout << SEPARATOR;
+    std::cout << "GL error check benchmark (" << ERROR_CHECK_BENCHMARK_CALLS << " calls)\n";
 
-    // Red image's format
-    GLenum format;
-    if (nrChannels == 1)
-        format = GL_RED;
-    else if (nrChannels == 3)
-        format = GL_RGB;
-    else if (nrChannels == 4)
-        format = GL_RGBA;
-    else
+    sf::ContextSettings settings;
+    settings.majorVersion = 3;
+    settings.minorVersion = 3;
+    settings.attributeFlags = sf::ContextSettings::Core | sf::ContextSettings::Debug;
+    sf::Context context(settings, 1, 1);
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK)
     {
-        std::cerr << "Unsupported number of channels (" << nrChannels << ") in texture: " << file_path << "\n";
-        stbi_image_free(data);
-        return 0;
+        std::cerr << "Error initializing GLEW!\n";
+        return;
     }
 
-    // Pass texture data to OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, 64 * sizeof(GLfloat), NULL, GL_DYNAMIC_DRAW);
+    GLfloat data[16] = {};
+
+    // Nanoseconds per call, glFinish keeps queued work out of the next measurement
+    auto run = [&](bool check) {
+        glFinish();
+        sf::Clock clock;
+        for (int i = 0; i < ERROR_CHECK_BENCHMARK_CALLS; ++i)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, (i % 4) * sizeof(data), sizeof(data), data);
+            if (check)
+                check_gl_error("Benchmark");
+        }
+        glFinish();
+        return clock.getElapsedTime().asMicroseconds() * 1000.0 / ERROR_CHECK_BENCHMARK_CALLS;
+    };
 
-    // Free image memory
-    stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture
+    double unchecked = run(false);
+    std::cout << "\tunchecked: " << unchecked << " ns per call\n";
+#ifdef ENABLE_GL_CHECKS
+    std::cout << "\tglGetError polling: " << run(true) << " ns per call\n";
+    if (init_gl_debug_output(false, DEBUG_OUTPUT_MIN_SEVERITY))
+    {
+        std::cout << "\tdebug callback: " << run(true) << " ns per call\n";
+        release_gl_debug_output();
+        init_gl_debug_output(true, DEBUG_OUTPUT_MIN_SEVERITY);
+        std::cout << "\tdebug callback, synchronous: " << run(true) << " ns per call\n";
+        release_gl_debug_output();
+    }
+    else
+    {
+        std::cout << "\tKHR_debug not available\n";
+    }
+#else
+    std::cout << "\tchecks compiled out in this build\n";
+#endif
 
-    return texture_id;
+    glDeleteBuffers(1, &buffer);
 }
 
 // Paths
@@ -437,6 +3761,15 @@ const std::string TEXTURE_PATH = ASSETS_PATH + "textures/";
 // --------------------
 int main()
 {
+    if (run_benchmarks)
+    {
+        benchmark_scene_graph();
+        benchmark_bvh();
+        benchmark_static_batching();
+        benchmark_gl_checks();
+        return 0;
+    }
+
     // OpenGL's context settings
     sf::ContextSettings settings;
     settings.depthBits = 24;     // Bits for depth buffer
@@ -444,6 +3777,10 @@ int main()
     settings.majorVersion = 3;   // OpenGL major version
     settings.minorVersion = 3;   // OpenGL minor version
     settings.attributeFlags = sf::ContextSettings::Core;
+#ifdef ENABLE_GL_CHECKS
+    if (enable_gl_debug_output)
+        settings.attributeFlags |= sf::ContextSettings::Debug;    // Drivers may only report through the callback in debug contexts
+#endif
 
     // Create window with OpenGL context settings
     sf::Window window(sf::VideoMode(WINDOW_WIDTH, WINDOW_HEIGHT, 32), WINDOW_TITLE, sf::Style::Titlebar | sf::Style::Close, settings);
@@ -455,6 +3792,10 @@ int main()
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
 
+    // Closed models enable face culling when drawn, meshlet normal cones assume the same winding
+    glFrontFace(GL_CCW);
+    glCullFace(GL_BACK);
+
     // Initialize GLEW (must be done after creating the window and OpenGL context)
     glewExperimental = GL_TRUE;
     if (glewInit() != GLEW_OK)
@@ -464,6 +3805,14 @@ int main()
     }
     check_gl_error("GLEW Initialization");
 
+#ifdef ENABLE_GL_CHECKS
+    // Report GL errors through the driver's callback instead of polling glGetError
+    if (enable_gl_debug_output && !init_gl_debug_output(DEBUG_OUTPUT_SYNCHRONOUS, DEBUG_OUTPUT_MIN_SEVERITY))
+    {
+        std::cout << "KHR_debug not available, polling glGetError.\n";
+    }
+#endif
+
     // Debug info of OpenGL and GPU versions
     const GLubyte* renderer = glGetString(GL_RENDERER);  // GPU name
     const GLubyte* version = glGetString(GL_VERSION);    // OpenGL version
@@ -517,13 +3866,81 @@ int main()
         window.close();  // Close the rendering window
         return -2;
     }
+    label_gl_object(GL_PROGRAM, shader_program, "Scene");
 
     // Use shader program
     glUseProgram(shader_program);
     check_gl_error("Using Shader Program");
 
+    // Headless capture renders into an offscreen framebuffer instead of the hidden window
+    float render_width = WINDOW_WIDTH;
+    float render_height = WINDOW_HEIGHT;
+    GLuint capture_fbo = 0;
+    GLuint capture_renderbuffers[2] = { 0, 0 };    // Colour, depth-stencil
+    if (enable_frame_capture && capture_headless)
+    {
+        window.setVisible(false);
+        window.setMouseCursorGrabbed(false);
+        render_width = static_cast<float>(CAPTURE_WIDTH);
+        render_height = static_cast<float>(CAPTURE_HEIGHT);
+
+        glGenFramebuffers(1, &capture_fbo);
+        glGenRenderbuffers(2, capture_renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, capture_renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, CAPTURE_WIDTH, CAPTURE_HEIGHT);
+        glBindRenderbuffer(GL_RENDERBUFFER, capture_renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, CAPTURE_WIDTH, CAPTURE_HEIGHT);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, capture_fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, capture_renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, capture_renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Capture framebuffer is incomplete.\n";
+        }
+        glViewport(0, 0, CAPTURE_WIDTH, CAPTURE_HEIGHT);
+        check_gl_error("Capture Framebuffer Setup");
+
+        size_t target_bytes = static_cast<size_t>(CAPTURE_WIDTH) * CAPTURE_HEIGHT * 4;
+        gpu_memory.track_allocation(GPU_MEMORY_RENDERBUFFER, capture_renderbuffers[0], target_bytes, "Capture framebuffer");
+        gpu_memory.track_allocation(GPU_MEMORY_RENDERBUFFER, capture_renderbuffers[1], target_bytes, "Capture framebuffer");
+    }
+
+    FrameCapture frame_capture;
+    if (enable_frame_capture && !frame_capture.init(static_cast<int>(render_width), static_cast<int>(render_height)))
+    {
+        // Cleanup: delete the capture target, shaders and close the window
+        glDeleteFramebuffers(1, &capture_fbo);
+        glDeleteRenderbuffers(2, capture_renderbuffers);
+        glDeleteProgram(shader_program);
+        glDeleteShader(fragment_shader);
+        glDeleteShader(vertex_shader);
+
+        window.close();
+        return -3;
+    }
+
+    // Scene is drawn at a variable resolution and upscaled into the output framebuffer.
+    // Captured sequences always render at full resolution so they do not depend on GPU load
+    DynamicResolution dynamic_resolution;
+    bool use_dynamic_resolution = enable_dynamic_resolution && !enable_frame_capture
+        && dynamic_resolution.init(static_cast<int>(render_width), static_cast<int>(render_height));
+
+    // Split screen and the reflection probe draw all their views in one submission
+    MultiViewRenderer multi_view;
+    bool use_multi_view = (enable_split_screen || enable_reflection_probe) && multi_view.init(shader_program);
+    bool use_split_screen = enable_split_screen && use_multi_view;
+    ReflectionProbe reflection_probe;
+    bool use_reflection_probe = enable_reflection_probe && use_multi_view;
+    if (use_reflection_probe)
+    {
+        reflection_probe.init();
+    }
+    glUseProgram(shader_program);
+
     // Declare and set projection matrix
-    glm::mat4 proj_matrix = glm::perspective(glm::radians(45.0f), WINDOW_WIDTH / WINDOW_HEIGHT, 0.01f, 100.0f);
+    glm::mat4 proj_matrix = glm::perspective(glm::radians(45.0f), render_width / render_height, 0.01f, 100.0f);
     GLint uni_proj = glGetUniformLocation(shader_program, "proj_matrix");
     if (uni_proj == -1)
     {
@@ -570,8 +3987,16 @@ int main()
     };
 
     // Load texture
+    TextureResidencyManager texture_residency(TEXTURE_MEMORY_BUDGET);
     std::string texture_name = "obanma.png";
-    GLuint texture_id = load_texture(TEXTURE_PATH + texture_name);
+    GLuint texture_id = enable_texture_streaming
+        ? texture_residency.load(TEXTURE_PATH + texture_name)
+        : load_texture(TEXTURE_PATH + texture_name);
+
+    // Transforms of every model
+    SceneGraph scene;
+    SceneBVH scene_bvh;     // Rebuilt whenever a model moves
+    std::vector<StaticMesh> static_meshes;      // Merged into batches once everything is loaded
 
     // Loading models
     for (size_t i = 0; i < model_files.size(); ++i)
@@ -589,23 +4014,83 @@ int main()
         srand(time(NULL));
         glm::vec3 color = (i < model_colors.size()) ? model_colors[i] : glm::vec3(static_cast<float>(rand()) / RAND_MAX, static_cast<float>(rand()) / RAND_MAX, static_cast<float>(rand()) / RAND_MAX);
 
-        // Create the moddel and add it to the list
-        Model* new_model = new Model(model_files[i], vertices, indices, color, shader_program, texture_id, texture_name);
-
         // Adjust model's positiona and rotationl properties
+        glm::vec3 position(0.0f);
+        glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
         if (i == 0) // First model (chair)
         {
-            new_model->model_matrix = glm::translate(new_model->model_matrix, glm::vec3(0.f, 0.0f, 0.0f));
+            position = glm::vec3(0.f, 0.0f, 0.0f);
         }
         else if (i == 1) // Second model (table)
         {
-            new_model->model_matrix = glm::translate(new_model->model_matrix, glm::vec3(-2.f, 0.0f, -3.0f));
-            new_model->model_matrix = glm::rotate(new_model->model_matrix, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+            position = glm::vec3(-2.f, 0.0f, -3.0f);
+            rotation = glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         }
 
+        // Placement is baked into the vertices of batched meshes
+        if (enable_static_batching)
+        {
+            StaticMesh mesh;
+            mesh.name = model_files[i];
+            mesh.vertices.swap(vertices);
+            mesh.indices.swap(indices);
+            mesh.world_matrix = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation);
+            mesh.color = color;
+            mesh.texture = texture_id;
+            mesh.texture_name = texture_name;
+            static_meshes.push_back(std::move(mesh));
+            continue;
+        }
+        SceneNode node = scene.add_node(NO_SCENE_NODE, position, rotation);
+
+        // Triangles are already in meshlet order when uploaded
+        bool closed = is_closed_mesh(vertices, indices);
+        std::vector<Meshlet> meshlets = build_meshlets(vertices, indices, closed);
+
+        // Create the moddel and add it to the list
+        Model* new_model = new Model(model_files[i], vertices, indices, color, shader_program, texture_id, texture_name, node);
+        new_model->closed = closed;
+        new_model->meshlets = meshlets;
+        new_model->bvh.build(vertices, indices);
         models.push_back(new_model);
     }
 
+    // One model per batch, already in world space and never attached to the scene graph
+    if (!static_meshes.empty())
+    {
+        sf::Clock batch_clock;
+        std::vector<StaticBatch> batches = merge_static_meshes(static_meshes);
+        for (size_t i = 0; i < batches.size(); ++i)
+        {
+            StaticBatch& batch = batches[i];
+            std::string name = "static_batch_" + std::to_string(i) + " (" + std::to_string(batch.mesh_count) + " meshes)";
+            bool closed = is_closed_mesh(batch.vertices, batch.indices);
+            std::vector<Meshlet> meshlets = build_meshlets(batch.vertices, batch.indices, closed);
+
+            Model* new_model = new Model(name, batch.vertices, batch.indices, batch.color, shader_program, batch.texture, batch.texture_name);
+            new_model->closed = closed;
+            new_model->meshlets = meshlets;
+            new_model->bvh.build(batch.vertices, batch.indices);
+            models.push_back(new_model);
+        }
+
+        std::cout << SEPARATOR;
+        std::cout << "Merged " << static_meshes.size() << " static meshes into " << batches.size() << " batches ("
+            << batch_clock.getElapsedTime().asMicroseconds() / 1000.0 << " ms).\n";
+        static_meshes.clear();
+    }
+
+    // Picking and collision structure, rebuilt whenever a node moves
+    auto rebuild_scene_bvh = [&]() {
+        std::vector<BVHInstance> instances;
+        for (size_t i = 0; i < models.size(); ++i)
+        {
+            instances.push_back(SceneBVH::make_instance(&models[i]->bvh, models[i]->model_matrix, static_cast<int>(i)));
+        }
+        scene_bvh.build(instances);
+    };
+    rebuild_scene_bvh();
+
     // Split models
     glm::vec3 chair_base_color(0.8f, 0.5f, 0.2f);   // Brown
     glm::vec3 chair_top_color(0.2f, 0.2f, 0.8f);    // Blue
@@ -619,8 +4104,10 @@ int main()
     for (size_t i = 0; i < models.size(); ++i)
     {
         std::cout << models[i]->name << "\n";
-        std::cout << "\tvertices=" << models[i]->vertices.size() / 5 << "\n";
-        std::cout << "\tindices=" << models[i]->indices.size() << "\n";
+        std::cout << "\tvertices=" << models[i]->vertex_count << "\n";
+        std::cout << "\tindices=" << models[i]->index_count << "\n";
+        std::cout << "\tmeshlets=" << models[i]->meshlets.size() << "\n";
+        std::cout << "\tbvh_nodes=" << models[i]->bvh.nodes.size() << "\n";
         std::cout << "\tcolour=(" << models[i]->color.r << ", " << models[i]->color.g << ", " << models[i]->color.b << ")\n";
         if (models[i]->texture != 0)
         {
@@ -640,6 +4127,10 @@ int main()
     std::cout << "[Left Shift] = speed increase.\n";
     std::cout << "[Space, Left Control] = up, down.\n";
     std::cout << "[Mouse] = Camera Rotaion XYZ Axis.\n";
+    std::cout << "[M] = GPU memory report.\n";
+    std::cout << "[Left Mouse] = Pick model at screen centre.\n";
+    if (use_reflection_probe)
+        std::cout << "[C] = Capture reflection probe at camera.\n";
 
     // Main event loop
     bool running = true;
@@ -655,6 +4146,10 @@ int main()
     // Mouse
     double mouse_sensitivity = 0.05;
 
+    // Viewport
+    float viewport_width = render_width;
+    float viewport_height = render_height;
+
     // Delta time
     sf::Clock delta_clock;
     float delta_time = 0.0f;
@@ -662,29 +4157,64 @@ int main()
     float time_accumulator = 0.0f; // Time passed since last FPS update
     int frame_count = 0;
 
+    // Meshlet culling statistics
+    size_t total_triangles = 0;
+    size_t visible_triangles = 0;
+
+    // On-demand rendering
+    bool frame_dirty = true;        // Something changed since the last rendered frame
+    bool idle = false;              // Last iteration rendered nothing, wait for input
+    unsigned long rendered_frames = 0;
+    unsigned long skipped_frames = 0;
+    sf::Clock frame_clock;          // Enforces the frame cap
+
+    // CPU time spent submitting the last rendered frame's draws
+    float submit_us = 0.0f;
+
     while (running)
     {
         // Update delta time
         delta_time = delta_clock.restart().asSeconds();
+        frame_clock.restart();
 
-        // Accumulate time and count frames
+        // Accumulate time, frames are counted once rendered
         time_accumulator += delta_time;
-        frame_count++;
 
         // Set the window title to current FPS
         if (time_accumulator >= update_interval)
         {
             // Get FPS from average time passed since last update
             int FPS = static_cast<int>(round(frame_count / time_accumulator));
-            window.setTitle(WINDOW_TITLE + " - FPS: " + std::to_string(FPS));
+            std::string title = WINDOW_TITLE + " - FPS: " + std::to_string(FPS);
+            if (enable_meshlet_culling && total_triangles > 0)
+            {
+                int culled_percent = static_cast<int>(round(100.0 * (total_triangles - visible_triangles) / total_triangles));
+                title += " - Culled: " + std::to_string(culled_percent) + "%";
+            }
+            if (enable_on_demand_rendering)
+            {
+                title += " - Skipped: " + std::to_string(skipped_frames);
+            }
+            window.setTitle(title);
 
             // Reset for next FPS update
             time_accumulator = 0.0f;
             frame_count = 0;
         }
 
+        // While idle, sleep until the next event instead of spinning
         sf::Event window_event;
-        while (window.pollEvent(window_event))
+        bool has_event = idle ? window.waitEvent(window_event) : window.pollEvent(window_event);
+        if (idle)
+        {
+            // Time spent waiting must not move the camera
+            delta_clock.restart();
+            frame_clock.restart();
+            delta_time = 0.0f;
+            idle = false;
+        }
+
+        while (has_event)
         {
             switch (window_event.type)
             {
@@ -698,6 +4228,22 @@ int main()
                 {
                     running = false;
                 }
+                else if (window_event.key.code == sf::Keyboard::M)
+                {
+                    gpu_memory.print_report();
+                    if (enable_texture_streaming)
+                        texture_residency.print_report();
+                }
+                else if (window_event.key.code == sf::Keyboard::C && use_reflection_probe)
+                {
+                    sf::Clock probe_clock;
+                    reflection_probe.capture(multi_view, models, camera_pos);
+                    float probe_us = static_cast<float>(probe_clock.getElapsedTime().asMicroseconds());
+                    glUseProgram(shader_program);
+
+                    std::cout << "Reflection probe: " << multi_view.draw_calls << " draws for " << multi_view.view_instances << " face instances, "
+                        << multi_view.culled_instances << " culled, " << probe_us << " us (main view: " << submit_us << " us)\n";
+                }
                 break;
             case sf::Event::MouseMoved:
                 if (enable_mouse_movement)
@@ -708,6 +4254,10 @@ int main()
                     double x_offset = static_cast<double>(local_pos.x - center_pos.x);
                     double y_offset = static_cast<double>(local_pos.y - center_pos.y);
 
+                    // Recentering the cursor reports a move of its own, ignore it
+                    if (x_offset == 0.0 && y_offset == 0.0)
+                        break;
+
                     // Apply the offset to yaw and pitch
                     camera_yaw += x_offset * mouse_sensitivity;
                     camera_pitch -= y_offset * mouse_sensitivity;
@@ -727,10 +4277,30 @@ int main()
                     sf::Mouse::setPosition(center_pos, window);
                 }
 
+                break;
+            case sf::Event::MouseButtonPressed:
+                // Pick along the view direction, the cursor is locked to the centre
+                if (window_event.mouseButton.button == sf::Mouse::Left)
+                {
+                    sf::Clock pick_clock;
+                    float distance = FLT_MAX;
+                    int picked = -1;
+                    bool hit = scene_bvh.pick(camera_pos, camera_front, distance, picked);
+                    float pick_us = static_cast<float>(pick_clock.getElapsedTime().asMicroseconds());
+
+                    if (hit)
+                        std::cout << "Picked " << models[picked]->name << " at distance " << distance << " (" << pick_us << " us)\n";
+                    else
+                        std::cout << "Picked nothing (" << pick_us << " us)\n";
+                }
                 break;
             case sf::Event::Resized:
                 // Update viewport
                 glViewport(0, 0, window_event.size.width, window_event.size.height);
+                viewport_width = static_cast<float>(window_event.size.width);
+                viewport_height = static_cast<float>(window_event.size.height);
+                if (use_dynamic_resolution)
+                    dynamic_resolution.resize(window_event.size.width, window_event.size.height);
 
                 // Update projection matrix
                 proj_matrix = glm::perspective(glm::radians(45.0f), static_cast<float>(window_event.size.width) / window_event.size.height, 0.01f, 100.0f);
@@ -741,11 +4311,18 @@ int main()
                 }
                 glUniformMatrix4fv(uni_proj, 1, GL_FALSE, glm::value_ptr(proj_matrix));
                 check_gl_error("Resized Event");
+                frame_dirty = true;
 
+                break;
+            case sf::Event::GainedFocus:
+                frame_dirty = true;
                 break;
             }
+
+            has_event = window.pollEvent(window_event);
         }
 
+        glm::vec3 previous_camera_pos = camera_pos;
         if (enable_keyboard_movement)
         {
             std::string input_debug = "Input: ";
@@ -826,6 +4403,30 @@ int main()
                 std::cout << input_debug << "\n";
         }
 
+        // Slide the camera sphere along geometry by sweeping each axis separately
+        if (enable_camera_collision && camera_pos != previous_camera_pos)
+        {
+            glm::vec3 movement = camera_pos - previous_camera_pos;
+            camera_pos = previous_camera_pos;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (movement[axis] == 0.0f)
+                    continue;
+
+                glm::vec3 direction(0.0f);
+                direction[axis] = movement[axis] > 0.0f ? 1.0f : -1.0f;
+                float distance = std::fabs(movement[axis]);
+                if (scene_bvh.sweep_sphere(camera_pos, direction, CAMERA_COLLISION_RADIUS, distance))
+                    distance = std::max(0.0f, distance - CAMERA_COLLISION_SKIN);
+                camera_pos += direction * distance;
+            }
+        }
+
+        if (camera_pos_changed || camera_pos != previous_camera_pos)
+        {
+            frame_dirty = true;
+        }
+
         if (camera_pos_changed)
         {
             // Update view matrix
@@ -842,19 +4443,144 @@ int main()
             camera_pos_changed = false;
         }
 
+        // Refresh world matrices of moved nodes and hand them to their models
+        if (scene.update() > 0)
+        {
+            frame_dirty = true;
+
+            for (auto& model : models)
+            {
+                if (model->scene_node != NO_SCENE_NODE)
+                    model->model_matrix = scene.get_world_matrix(model->scene_node);
+            }
+            rebuild_scene_bvh();
+        }
+
+        // Stream texture detail according to each model's size on screen. Only models inside the
+        // camera frustum ask for detail, the others age out and are evicted first. Split screen
+        // has a second camera, every model asks there
+        if (enable_texture_streaming)
+        {
+            Frustum frustum = Frustum::from_matrix(proj_matrix * view_matrix);
+            for (auto& model : models)
+            {
+                if (model->texture == 0)
+                    continue;
+
+                float scale = std::max(glm::length(glm::vec3(model->model_matrix[0])), std::max(glm::length(glm::vec3(model->model_matrix[1])), glm::length(glm::vec3(model->model_matrix[2]))));
+                glm::vec3 world_center = glm::vec3(model->model_matrix * glm::vec4(model->bounds_center, 1.0f));
+                if (use_split_screen || frustum.sphere_visible(world_center, model->bounds_radius * scale))
+                {
+                    float scaled_height = use_dynamic_resolution ? viewport_height * dynamic_resolution.scale : viewport_height;
+                    texture_residency.request(model->texture, model->screen_space_size(camera_pos, proj_matrix, scaled_height));
+                }
+            }
+            if (texture_residency.update())
+                frame_dirty = true;
+        }
+
+        // Nothing changed: keep the last presented frame and wait for input.
+        // A frame rendered at reduced resolution is redrawn at full scale first
+        if (enable_on_demand_rendering && !frame_dirty && !enable_frame_capture)
+        {
+            if (use_dynamic_resolution && dynamic_resolution.scale < DRS_MAX_SCALE)
+            {
+                dynamic_resolution.settle();
+            }
+            else
+            {
+                skipped_frames++;
+                idle = true;
+                continue;
+            }
+        }
+        frame_dirty = false;
+        rendered_frames++;
+        frame_count++;
+
+        // Redirect rendering into the scaled target
+        if (use_dynamic_resolution)
+        {
+            glUseProgram(shader_program);
+            dynamic_resolution.begin_frame();
+        }
+
         // Clear the screen to black
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         check_gl_error("Clearing Buffers");
 
+        // Cull meshlets against the camera, multi-view draws cull whole models per view instead
+        if (enable_meshlet_culling && !use_split_screen)
+        {
+            Frustum frustum = Frustum::from_matrix(proj_matrix * view_matrix);
+            total_triangles = 0;
+            visible_triangles = 0;
+            for (auto& model : models)
+            {
+                total_triangles += model->index_count / 3;
+                visible_triangles += model->meshlets.empty() ? model->index_count / 3 : model->cull_meshlets(frustum, camera_pos);
+            }
+        }
+
         // Render models
-        for (auto& model : models)
+        sf::Clock submit_clock;
+        if (use_split_screen)
+        {
+            // Player view on the left, overhead view following the player on the right
+            glm::mat4 tile_proj = glm::perspective(glm::radians(45.0f), viewport_width * 0.5f / viewport_height, 0.01f, 100.0f);
+            glm::vec3 overhead_forward = glm::vec3(camera_front.x, 0.0f, camera_front.z);
+            if (glm::length(overhead_forward) < 0.001f)
+                overhead_forward = glm::vec3(0.0f, 0.0f, -1.0f);
+
+            std::vector<RenderView> views(2);
+            views[0].view_proj = tile_proj * view_matrix;
+            views[0].rect = glm::vec4(0.5f, 1.0f, -0.5f, 0.0f);
+            views[1].view_proj = tile_proj * glm::lookAt(camera_pos + glm::vec3(0.0f, SPLIT_SCREEN_OVERHEAD_HEIGHT, 0.0f), camera_pos, glm::normalize(overhead_forward));
+            views[1].rect = glm::vec4(0.5f, 1.0f, 0.5f, 0.0f);
+
+            multi_view.draw(models, views, false);
+            glUseProgram(shader_program);
+        }
+        else
         {
-            model->draw(shader_program);
+            for (auto& model : models)
+            {
+                model->draw(shader_program);
+            }
+        }
+        submit_us = static_cast<float>(submit_clock.getElapsedTime().asMicroseconds());
+
+        if (use_dynamic_resolution)
+        {
+            dynamic_resolution.end_frame(capture_fbo, shader_program);
+        }
+
+        // Read the frame back before it is presented
+        if (enable_frame_capture)
+        {
+            frame_capture.capture();
+            if (CAPTURE_FRAME_COUNT > 0 && frame_capture.captured >= static_cast<unsigned long>(CAPTURE_FRAME_COUNT))
+                running = false;
         }
 
         // Swap the front and back buffers
         window.display();
+
+        // Cap the frame rate while the scene keeps changing
+        if (enable_on_demand_rendering && !enable_frame_capture && ON_DEMAND_FRAME_CAP > 0)
+        {
+            sf::Time frame_budget = sf::microseconds(1000000 / ON_DEMAND_FRAME_CAP);
+            sf::Time elapsed = frame_clock.getElapsedTime();
+            if (elapsed < frame_budget)
+                sf::sleep(frame_budget - elapsed);
+        }
+    }
+
+    if (enable_on_demand_rendering)
+    {
+        std::cout << SEPARATOR;
+        std::cout << "Rendered " << rendered_frames << " frames, skipped " << skipped_frames << ".\n";
     }
 
     // Cleanup: delete models, shaders, buffers etc. and close the window
@@ -865,6 +4591,44 @@ int main()
 
     models.clear();
 
+    if (enable_frame_capture)
+    {
+        frame_capture.finish();
+    }
+    if (use_dynamic_resolution)
+    {
+        dynamic_resolution.release();
+    }
+    if (use_reflection_probe)
+    {
+        reflection_probe.release();
+    }
+    if (use_multi_view)
+    {
+        multi_view.release();
+    }
+    if (capture_fbo != 0)
+    {
+        gpu_memory.track_release(GPU_MEMORY_RENDERBUFFER, capture_renderbuffers[0]);
+        gpu_memory.track_release(GPU_MEMORY_RENDERBUFFER, capture_renderbuffers[1]);
+        glDeleteFramebuffers(1, &capture_fbo);
+        glDeleteRenderbuffers(2, capture_renderbuffers);
+    }
+
+    // Textures are shared between models and released once here
+    if (enable_texture_streaming)
+    {
+        texture_residency.release_all();
+    }
+    else if (texture_id != 0)
+    {
+        gpu_memory.track_release(GPU_MEMORY_TEXTURE, texture_id);
+        glDeleteTextures(1, &texture_id);
+    }
+
+    gpu_memory.print_report();
+
+    release_gl_debug_output();
     glDeleteProgram(shader_program);
     glDeleteShader(fragment_shader);
     glDeleteShader(vertex_shader);